@@ -0,0 +1,110 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CompiledFilter.h
+// Project:     perfLib
+// Purpose:     Set of wildcard patterns matched in a single pass
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFCOMPILEDFILTER_H__
+#define _PERFCOMPILEDFILTER_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file CompiledFilter.h
+///
+/// Filter built from a list of wildcard patterns ('*' - any sequence, 
+/// '?' - any character). Name matches filter if it matches any of patterns.
+///
+/// Patterns containing other characters which can be special in regular
+/// expressions (see WILDCARD_SPECIAL_CHARS) are converted to regular 
+/// expressions (Boost.Regex) the same way as WildcardMatcher (base library) 
+/// does, so filters keep semantics of previous getByFilter.
+///
+/// All patterns are combined into one automaton: each DFA state is a set of
+/// positions in patterns, states and transitions are created lazily on first 
+/// use, so each name is checked in one pass over it's characters.
+/// Results are cached per name until patterns are changed. Cache is bounded,
+/// when full, names not used since last pass of CLOCK hand are replaced.
+///
+/// Not thread-safe - matching updates the automaton & cache. Keep one filter
+/// per reporting thread and reuse it between reports.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+#include <map>
+
+#include "boost/ptr_container/ptr_vector.hpp"
+
+#include "perf/details/ptypes.h"
+#include "perf/details/FlatNameMap.h"
+#include "perf/details/NameTrie.h"
+
+namespace perf {
+
+namespace Details {
+class RegexMatcher;
+};
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// When automaton grows above this number of states, it is rebuilt from scratch
+const uint COMPILED_FILTER_MAX_STATES = 1024;
+/// Max number of names with cached result
+const uint COMPILED_FILTER_MAX_CACHE = 65536;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+class CompiledFilter {
+public:
+  CompiledFilter();
+  ~CompiledFilter();
+  void addPattern(const dtpString &pattern);
+  void clear();
+  uint getPatternCount() const { return m_patterns.size(); }
+  const dtpString &getPattern(uint index) const { return m_patterns[index]; }
+  /// \return <true> if name matches any of patterns
+  bool isMatching(const dtpString &name);
+  /// \return <true> if pattern uses only '*' and '?' as special characters
+  static bool isSimplePattern(const dtpString &pattern);
+protected:
+  typedef std::vector<uint> PositionSet;
+  typedef std::map<PositionSet, uint> StateMap;
+  struct CacheEntry {
+    bool matching;
+    // set on each hit, cleared by CLOCK hand
+    bool referenced;
+  };
+  void invalidate();
+  void compile();
+  bool match(const dtpString &name);
+  uint getNextState(uint state, unsigned char c);
+  uint addState(const PositionSet &positions);
+  void addClosure(PositionSet &positions) const;
+  uint findVictim();
+private:
+  std::vector<dtpString> m_patterns;
+  bool m_compiled;
+  // all patterns, each one terminated with '\0' (accepting position)
+  dtpString m_positions;
+  uint m_startState;
+  std::vector<PositionSet> m_states;
+  std::vector<bool> m_accepting;
+  StateMap m_stateMap;
+  // 256 transitions per state, -1 = not calculated yet
+  std::vector<int> m_next;
+  Details::FlatNameMap<CacheEntry> m_cache;
+  uint m_clockHand;
+  // patterns which are not simple
+  boost::ptr_vector<Details::RegexMatcher> m_matchers;
+};
+
+}; // namespace perf
+
+#endif // _PERFCOMPILEDFILTER_H__
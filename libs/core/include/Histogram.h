@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        Histogram.h
+// Project:     perfLib
+// Purpose:     Log-linear histogram of recorded values
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFHISTOGRAM_H__
+#define _PERFHISTOGRAM_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file Histogram.h
+///
+/// Histogram with HDR-style log-linear buckets: values below 32 have their 
+/// own buckets, each higher power-of-2 range is split into 32 linear 
+/// sub-buckets. Relative error of reported percentiles is below 1/32 (~3%),
+/// memory footprint is fixed (HISTOGRAM_BUCKET_COUNT counters).
+/// Recording is lock-free, histograms can be merged.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include "perf/details/ptypes.h"
+#include "perf/details/atomic_ops.h"
+
+namespace perf {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const uint HISTOGRAM_SUB_BUCKET_BITS = 5;
+const uint HISTOGRAM_SUB_BUCKET_COUNT = (1U << HISTOGRAM_SUB_BUCKET_BITS);
+const uint HISTOGRAM_BUCKET_COUNT = HISTOGRAM_SUB_BUCKET_COUNT * (64 - HISTOGRAM_SUB_BUCKET_BITS + 1);
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+/// Summary of histogram
+struct HistogramStats {
+  uint64 count;
+  uint64 sum;
+  uint64 min;
+  uint64 max;
+  uint64 p50;
+  uint64 p90;
+  uint64 p99;
+  uint64 p999;
+  double getMean() const { return (count > 0) ? (static_cast<double>(sum) / static_cast<double>(count)) : 0.0; }
+};
+
+class Histogram {
+public:
+  Histogram();
+  ~Histogram() {}
+  /// Records value, can be called by many threads at once
+  void record(uint64 value);
+  /// Records value without bus locks, only one thread can record to this histogram
+  void recordSingleWriter(uint64 value);
+  /// Adds all values recorded in <src>
+  void merge(const Histogram &src);
+  void reset();
+  uint64 getCount() const;
+  uint64 getMin() const;
+  uint64 getMax() const;
+  uint64 getSum() const { return Details::atomic_load(&m_sum); }
+  /// Returns value below or equal to which <percent> of recorded values fall
+  /// (upper bound of bucket, never above max recorded value)
+  uint64 getPercentile(double percent) const;
+  void getStats(HistogramStats &output) const;
+  static uint getBucketIndex(uint64 value);
+  static uint64 getBucketLowerBound(uint index);
+  static uint64 getBucketUpperBound(uint index);
+private:
+  volatile uint64 m_counts[HISTOGRAM_BUCKET_COUNT];
+  volatile uint64 m_sum;
+  volatile uint64 m_min;
+  volatile uint64 m_max;
+};
+
+}; // namespace perf
+
+#endif // _PERFHISTOGRAM_H__
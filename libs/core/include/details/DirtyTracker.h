@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        DirtyTracker.h
+// Project:     perfLib
+// Purpose:     Tracks indexes of items changed since a given generation
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFDIRTYTRACKER_H__
+#define _PERFDIRTYTRACKER_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file DirtyTracker.h
+///
+/// Writers mark item index as changed with mark(), readers ask for indexes
+/// changed after generation returned by previous call (getChanged).
+///
+/// - marks are kept in a two-level bitmap: one bit per index and one summary
+///   bit per chunk of indexes, so collecting marks costs time proportional
+///   to the number of changed chunks, not to the number of items
+/// - mark() of an already marked index only reads the bitmap, so each
+///   index costs one atomic operation per collection period; mark() must
+///   be called after the value is written, it starts with a full fence, 
+///   so the value is visible before the bit is checked (otherwise reader 
+///   could clear the bit and read the old value, losing the update)
+/// - each getChanged() call closes a "round" (generation), last 
+///   DIRTY_HISTORY_SIZE non-empty rounds are kept, so readers with different
+///   intervals can share the tracker; rounds closed by a fast reader can 
+///   push out rounds not seen yet by a slow one - such reader gets 
+///   <complete> = false and must visit all items (changes are never 
+///   silently missed)
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+#include <deque>
+
+#include "perf/details/ptypes.h"
+#include "perf/details/platform.h"
+#include "perf/details/atomic_ops.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const uint DIRTY_CHUNK_BITS = 10;
+const uint DIRTY_CHUNK_SIZE = (1U << DIRTY_CHUNK_BITS);
+const uint DIRTY_CHUNK_WORDS = DIRTY_CHUNK_SIZE / 64;
+const uint DIRTY_MAX_CHUNKS = 4096;
+/// Max number of tracked indexes
+const uint DIRTY_MAX_SIZE = DIRTY_MAX_CHUNKS * DIRTY_CHUNK_SIZE;
+/// Number of rounds (generations) kept for readers
+const uint DIRTY_HISTORY_SIZE = 64;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+class DirtyTracker {
+public:
+  DirtyTracker();
+  ~DirtyTracker();
+  /// Marks index as changed, can be called by any thread
+  void mark(uint index)
+  {
+    assert(index < DIRTY_MAX_SIZE);
+    // StoreLoad: value written by caller is visible before bit is checked
+    atomic_thread_fence();
+    volatile uint64 *chunk = atomic_load_acquire(&m_chunks[index >> DIRTY_CHUNK_BITS]);
+    uint64 bit = static_cast<uint64>(1) << (index & 63);
+    if (PERF_LIKELY(chunk != DTP_NULL))
+    {
+      if (PERF_LIKELY((atomic_load(&chunk[(index & (DIRTY_CHUNK_SIZE - 1)) >> 6]) & bit) != 0))
+        return;
+    }
+    markSlow(index, bit);
+  }
+  /// Marks indexes [first, first + count) as changed, checks whole words of bitmap at once
+  void markRange(uint first, uint count);
+
+  /// Collects marked indexes, appends indexes changed after generation <since>
+  /// to output (sorted, without duplicates).
+  /// Sets <complete> to false if changes after <since> are not known (since = 0 or 
+  /// rounds after it were pushed out of history), caller must visit all items then.
+  /// \return current generation, to be passed as <since> in next call
+  uint64 getChanged(uint64 since, std::vector<uint> &output, bool &complete);
+protected:
+  struct Round {
+    uint64 generation;
+    std::vector<uint> indexes;
+  };
+
+  /// Sets <bits> in bitmap word of index, then summary bit of it's chunk
+  void markSlow(uint index, uint64 bits);
+  /// Moves marked indexes to output and clears marks
+  void collect(std::vector<uint> &output);
+private:
+  // no copy
+  DirtyTracker(const DirtyTracker &);
+  DirtyTracker &operator=(const DirtyTracker &);
+private:
+  volatile uint64 * volatile m_chunks[DIRTY_MAX_CHUNKS];
+  // one bit for each chunk with marked indexes
+  volatile uint64 m_summary[DIRTY_MAX_CHUNKS / 64];
+  std::deque<Round> m_history;
+  uint64 m_generation;
+  // generation of oldest round in history
+  uint64 m_firstGeneration;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFDIRTYTRACKER_H__
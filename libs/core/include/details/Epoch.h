@@ -0,0 +1,147 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        Epoch.h
+// Project:     perfLib
+// Purpose:     Epoch-based reclamation of objects shared with lock-free readers
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFEPOCH_H__
+#define _PERFEPOCH_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file Epoch.h
+///
+/// Objects unlinked from lock-free structures (registry entries, old hash
+/// tables) cannot be deleted immediately - other threads can still use them.
+/// Readers wrap their access in EpochGuard, writers pass unlinked objects
+/// to Epoch::retire(). Object is deleted by Epoch::reclaim() when every
+/// thread which could have seen it has left it's guarded section.
+///
+/// - guards can be nested, only the outermost one publishes thread's state
+/// - each thread has one record, reused by another thread after exit
+/// - reclaim() does not block, objects of a thread stuck in a guard wait
+///   for the next call
+/// - besides writers, exporters call reclaimPending() on each visit, so
+///   objects do not wait for the next removal
+/// - objects still waiting at program exit are not deleted
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+
+#include "perf/details/ptypes.h"
+#include "perf/details/platform.h"
+#include "perf/details/atomic_ops.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// Number of attempts to advance global epoch in a single reclaim() call
+const uint EPOCH_RECLAIM_ROUNDS = 3;
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+/// Function deleting retired object
+typedef void (*EpochDeleter)(void *ptr);
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+/// State of a single thread, padded to cache line
+struct EpochRecord {
+  /// (epoch << 1) | 1 when thread is inside guard, zero otherwise
+  volatile uint64 state;
+  uint depth;
+  volatile uint used;
+  EpochRecord *next;
+  char padding[PERF_CACHE_LINE_SIZE - sizeof(uint64) - 2 * sizeof(uint) - sizeof(EpochRecord *)];
+};
+
+class Epoch {
+public:
+  /// Marks current thread as reading shared objects
+  static void enter()
+  {
+    EpochRecord *rec = current();
+    if (rec->depth++ == 0)
+    {
+      atomic_store(&rec->state, (atomic_load(&m_global) << 1) | 1);
+      // state must be visible before any shared pointer is read
+      atomic_thread_fence();
+    }
+  }
+
+  /// Marks end of read started with enter()
+  static void leave()
+  {
+    EpochRecord *rec = m_current;
+    if (--rec->depth == 0)
+      atomic_store_release(&rec->state, static_cast<uint64>(0));
+  }
+
+  /// Schedules deletion of object which is no longer reachable for new readers
+  static void retire(void *ptr, EpochDeleter deleter);
+  /// Deletes retired objects which cannot be used by any reader.
+  /// Deleters are called outside of internal lock.
+  /// \return number of deleted objects
+  static uint reclaim();
+  /// Calls reclaim() if any object waits for deletion, without taking a lock otherwise.
+  /// Must not be called while holding a lock used by deleters.
+  static void reclaimPending()
+  {
+    if (atomic_load(&m_pending) != 0)
+      reclaim();
+  }
+  /// Returns number of objects waiting for deletion
+  static uint getPendingCount();
+protected:
+  struct Retired {
+    void *ptr;
+    EpochDeleter deleter;
+    uint64 epoch;
+  };
+  typedef std::vector<Retired> RetiredColn;
+
+  static EpochRecord *current()
+  {
+    EpochRecord *res = m_current;
+    if (PERF_UNLIKELY(res == DTP_NULL))
+      res = attach();
+    return res;
+  }
+  static EpochRecord *attach();
+  static void detach(EpochRecord *rec);
+  static bool tryAdvance();
+private:
+  static PERF_THREAD_LOCAL EpochRecord *m_current;
+  static EpochRecord *volatile m_records;
+  static volatile uint64 m_global;
+  static RetiredColn m_retired;
+  /// Size of m_retired, readable without lock
+  static volatile uint m_pending;
+};
+
+/// Keeps current thread inside epoch for it's lifetime
+class EpochGuard {
+public:
+  EpochGuard() { Epoch::enter(); }
+  ~EpochGuard() { Epoch::leave(); }
+private:
+  // no copy
+  EpochGuard(const EpochGuard &);
+  EpochGuard &operator=(const EpochGuard &);
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFEPOCH_H__
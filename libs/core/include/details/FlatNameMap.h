@@ -0,0 +1,171 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        FlatNameMap.h
+// Project:     perfLib
+// Purpose:     Single-threaded flat hash map of names to values
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFFLATNAMEMAP_H__
+#define _PERFFLATNAMEMAP_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file FlatNameMap.h
+///
+/// Map of names to values for private (single-threaded) collections.
+/// Entries are stored in a contiguous vector in order of insertion,
+/// lookups use open-addressing index of entry positions.
+/// Not thread-safe.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+
+#include "perf/details/ptypes.h"
+#include "perf/details/NameHash.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+template<typename T>
+class FlatNameMap {
+public:
+  struct Entry {
+    dtpString name;
+    uint64 hash;
+    T value;
+  };
+
+  FlatNameMap() {}
+  ~FlatNameMap() {}
+
+  /// Returns pointer to value or NULL if name is not found
+  T *find(const dtpString &name)
+  {
+    uint pos = findPos(name, name_hash(name));
+    return (m_index.empty() || (m_index[pos] == 0)) ? DTP_NULL : &(m_entries[m_index[pos] - 1].value);
+  }
+
+  /// Returns value for name, adds default value if name is not found
+  T &get(const dtpString &name)
+  {
+    uint64 hash = name_hash(name);
+    if ((m_entries.size() + 1) * 2 > m_index.size())
+      grow();
+
+    uint pos = findPos(name, hash);
+    if (m_index[pos] == 0)
+    {
+      Entry entry;
+      entry.name = name;
+      entry.hash = hash;
+      entry.value = T();
+      m_entries.push_back(entry);
+      m_index[pos] = m_entries.size();
+    }
+    return m_entries[m_index[pos] - 1].value;
+  }
+
+  /// Replaces name of entry at <index>, e.g. to evict it from a bounded cache.
+  /// New name must not be in map yet.
+  /// \return value of entry, reset to default
+  T &replace(uint index, const dtpString &name)
+  {
+    Entry &entry = m_entries[index];
+    unlink(findPos(entry.name, entry.hash));
+
+    entry.name = name;
+    entry.hash = name_hash(name);
+    entry.value = T();
+    m_index[findPos(name, entry.hash)] = index + 1;
+    return entry.value;
+  }
+
+  uint size() const { return m_entries.size(); }
+  bool empty() const { return m_entries.empty(); }
+  const Entry &at(uint index) const { return m_entries[index]; }
+  T &valueAt(uint index) { return m_entries[index].value; }
+
+  void clear()
+  {
+    m_entries.clear();
+    m_index.clear();
+  }
+
+protected:
+  /// Returns position of name in index or position of empty index slot
+  uint findPos(const dtpString &name, uint64 hash) const
+  {
+    if (m_index.empty())
+      return 0;
+
+    uint mask = m_index.size() - 1;
+    uint i = static_cast<uint>(hash) & mask;
+    uint entryNo;
+
+    while((entryNo = m_index[i]) != 0)
+    {
+      const Entry &entry = m_entries[entryNo - 1];
+      if ((entry.hash == hash) && (entry.name == name))
+        break;
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  /// Removes index slot, entries placed after it by collisions are moved back
+  void unlink(uint pos)
+  {
+    uint mask = m_index.size() - 1;
+    uint next = pos;
+    uint home;
+
+    for(;;)
+    {
+      next = (next + 1) & mask;
+      if (m_index[next] == 0)
+        break;
+      home = static_cast<uint>(m_entries[m_index[next] - 1].hash) & mask;
+      // entry can be moved if it's home slot is not between pos and next
+      if (((next - home) & mask) >= ((next - pos) & mask))
+      {
+        m_index[pos] = m_index[next];
+        pos = next;
+      }
+    }
+    m_index[pos] = 0;
+  }
+
+  void grow()
+  {
+    uint capacity = m_index.empty() ? 16 : m_index.size() * 2;
+    m_index.assign(capacity, 0);
+
+    uint mask = capacity - 1;
+    uint i;
+    for(uint j=0, epos = m_entries.size(); j != epos; j++)
+    {
+      i = static_cast<uint>(m_entries[j].hash) & mask;
+      while(m_index[i] != 0)
+        i = (i + 1) & mask;
+      m_index[i] = j + 1;
+    }
+  }
+
+private:
+  std::vector<Entry> m_entries;
+  // entry position + 1, zero for empty slot
+  std::vector<uint> m_index;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFFLATNAMEMAP_H__
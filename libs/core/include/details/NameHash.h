@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        NameHash.h
+// Project:     perfLib
+// Purpose:     Hash function for counter & timer names
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFNAMEHASH_H__
+#define _PERFNAMEHASH_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file NameHash.h
+///
+/// 64-bit FNV-1a hash of item names. 
+/// With C++11 compiler name_hash(const char *) can be evaluated at compile 
+/// time, so hash of a string literal can be used as a template argument.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include "perf/details/ptypes.h"
+#include "perf/details/platform.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const uint64 NAME_HASH_OFFSET = 14695981039346656037ULL;
+const uint64 NAME_HASH_PRIME = 1099511628211ULL;
+
+// ----------------------------------------------------------------------------
+// Function definitions
+// ----------------------------------------------------------------------------
+#ifdef PERF_HAS_CONSTEXPR
+constexpr uint64 name_hash_step(const char *str, uint64 hash)
+{
+  return (*str == 0) ? hash : 
+    name_hash_step(str + 1, (hash ^ static_cast<uint64>(static_cast<unsigned char>(*str))) * NAME_HASH_PRIME);
+}
+
+/// Calculates hash of zero-terminated name, can be evaluated at compile time
+constexpr uint64 name_hash(const char *str)
+{
+  return name_hash_step(str, NAME_HASH_OFFSET);
+}
+#else
+/// Calculates hash of zero-terminated name
+inline uint64 name_hash(const char *str)
+{
+  uint64 res = NAME_HASH_OFFSET;
+  for(; *str != 0; str++)
+    res = (res ^ static_cast<uint64>(static_cast<unsigned char>(*str))) * NAME_HASH_PRIME;
+  return res;
+}
+#endif
+
+/// Calculates hash of name with a given length
+inline uint64 name_hash(const char *str, size_t len)
+{
+  uint64 res = NAME_HASH_OFFSET;
+  for(const char *epos = str + len; str != epos; str++)
+    res = (res ^ static_cast<uint64>(static_cast<unsigned char>(*str))) * NAME_HASH_PRIME;
+  return res;
+}
+
+inline uint64 name_hash(const dtpString &str)
+{
+  return name_hash(str.c_str(), str.length());
+}
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFNAMEHASH_H__
@@ -0,0 +1,408 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        NameRegistry.h
+// Project:     perfLib
+// Purpose:     Read-mostly concurrent registry of named items
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFNAMEREGISTRY_H__
+#define _PERFNAMEREGISTRY_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file NameRegistry.h
+///
+/// Registry of named items optimized for lookups of existing names.
+///
+/// - lookups (find, size, at) do not take any lock
+/// - inserts & removals must be serialized by caller (e.g. inside omp critical section)
+/// - entries are never moved, each one has a stable index
+///
+/// Hash table uses open addressing. When it grows, a new table is published
+/// with a single pointer store, so readers can finish their lookups on the old one.
+/// Reader using an old table can miss a name inserted just now - callers
+/// should repeat the lookup under insert lock before inserting.
+///
+/// Removal must be enabled in constructor. Without it, old tables are kept
+/// until registry is destroyed (at most as much memory as the current table)
+/// and lookups do not need any guard.
+/// With removal enabled, old tables are retired with Epoch and a removed 
+/// entry is unlinked (at() returns NULL for it's index) and returned
+/// to the caller, which retires it and calls release() when no reader can
+/// use it anymore. Only then it's index is reused - with a new generation
+/// number, so index-based copies (snapshots) can detect the change.
+/// Readers of such registry must stay inside EpochGuard during lookups
+/// and while they use returned values (lookups under insert lock are safe).
+///
+/// Optional limits (number of entries, approximate memory) are not enforced
+/// by insert - callers check canInsert() and handle rejected names.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+#include <stdexcept>
+
+#include "perf/details/ptypes.h"
+#include "perf/details/atomic_ops.h"
+#include "perf/details/NameHash.h"
+#include "perf/details/Epoch.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const uint NAME_REGISTRY_CHUNK_BITS = 10;
+const uint NAME_REGISTRY_CHUNK_SIZE = (1U << NAME_REGISTRY_CHUNK_BITS);
+const uint NAME_REGISTRY_CHUNK_MASK = NAME_REGISTRY_CHUNK_SIZE - 1;
+const uint NAME_REGISTRY_MAX_CHUNKS = 4096;
+const uint NAME_REGISTRY_MAX_SIZE = NAME_REGISTRY_MAX_CHUNKS * NAME_REGISTRY_CHUNK_SIZE;
+const uint NAME_REGISTRY_INIT_CAPACITY = 64;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+template<typename T>
+class NameRegistry {
+public:
+  struct Entry {
+    dtpString name;
+    uint64 hash;
+    uint index;
+    /// number of times index has been reused
+    uint generation;
+    T *value;
+  };
+
+  /// \param removable <true> if remove() can be used, see description
+  explicit NameRegistry(bool removable = false)
+  {
+    m_removable = removable;
+    m_count = 0;
+    m_liveCount = 0;
+    m_tombstones = 0;
+    m_maxSize = NAME_REGISTRY_MAX_SIZE;
+    m_maxMemory = 0;
+    for(uint i=0; i != NAME_REGISTRY_MAX_CHUNKS; i++)
+      m_chunks[i] = DTP_NULL;
+    m_table = newTable(NAME_REGISTRY_INIT_CAPACITY);
+    m_memory = tableCost(NAME_REGISTRY_INIT_CAPACITY);
+  }
+
+  ~NameRegistry()
+  {
+    for(uint i=0, epos = m_count; i != epos; i++)
+    {
+      Entry *entry = m_chunks[i >> NAME_REGISTRY_CHUNK_BITS][i & NAME_REGISTRY_CHUNK_MASK];
+      if (entry == DTP_NULL)
+        continue;
+      delete entry->value;
+      delete entry;
+    }
+
+    for(uint i=0; i != NAME_REGISTRY_MAX_CHUNKS; i++)
+      delete [] m_chunks[i];
+
+    for(uint i=0, epos = m_oldTables.size(); i != epos; i++)
+      deleteTable(m_oldTables[i]);
+    deleteTable(m_table);
+  }
+
+  /// Finds value by name, returns NULL if not found
+  T *find(const dtpString &name) const
+  {
+    return find(name, name_hash(name));
+  }
+
+  /// Finds value by name with already calculated hash
+  T *find(const dtpString &name, uint64 hash) const
+  {
+    const Entry *entry = findEntry(atomic_load_acquire(&m_table), name, hash);
+    return (entry == DTP_NULL) ? DTP_NULL : entry->value;
+  }
+
+  /// Adds new item, registry takes ownership of value.
+  /// Caller must serialize inserts and make sure name is not registered yet.
+  T *insert(const dtpString &name, uint64 hash, T *value)
+  {
+    uint index = nextIndex();
+    if (index >= NAME_REGISTRY_MAX_SIZE)
+    {
+      delete value;
+      throw std::length_error("name registry is full");
+    }
+
+    m_memory += entryCost(name);
+
+    uint chunkIdx = index >> NAME_REGISTRY_CHUNK_BITS;
+    if (m_chunks[chunkIdx] == DTP_NULL)
+    {
+      Entry * volatile *chunk = new Entry *[NAME_REGISTRY_CHUNK_SIZE];
+      for(uint i=0; i != NAME_REGISTRY_CHUNK_SIZE; i++)
+        chunk[i] = DTP_NULL;
+      m_memory += NAME_REGISTRY_CHUNK_SIZE * sizeof(Entry *);
+      atomic_store_release(&m_chunks[chunkIdx], chunk);
+    }
+
+    Entry *entry = new Entry();
+    entry->name = name;
+    entry->hash = hash;
+    entry->index = index;
+    entry->value = value;
+    if (index == m_count)
+    {
+      entry->generation = 0;
+      m_generations.push_back(0);
+    } else {
+      m_freeIndexes.pop_back();
+      entry->generation = ++m_generations[index];
+    }
+
+    if (needsGrow())
+      grow();
+
+    // publish entry
+    if (addToTable(m_table, entry))
+      m_tombstones--;
+    atomic_store_release(&(m_chunks[chunkIdx][index & NAME_REGISTRY_CHUNK_MASK]), entry);
+    m_liveCount++;
+    if (index == m_count)
+      atomic_store_release(&m_count, index + 1);
+    return value;
+  }
+
+  /// Unlinks entry with a given name, so it is no longer found by new lookups.
+  /// Caller must serialize removals with inserts, retire returned entry
+  /// and call release() for it when it cannot be used by readers.
+  /// \return removed entry or NULL if name is not registered
+  Entry *remove(const dtpString &name)
+  {
+    assert(m_removable);
+    uint64 hash = name_hash(name);
+    Table *table = m_table;
+    Entry *entry;
+    uint i;
+
+    for(i = static_cast<uint>(hash) & table->mask; ; i = (i + 1) & table->mask)
+    {
+      entry = table->slots[i];
+      if (entry == DTP_NULL)
+        return DTP_NULL;
+      if ((entry != tombstone()) && (entry->hash == hash) && (entry->name == name))
+        break;
+    }
+
+    atomic_store_release(&(table->slots[i]), tombstone());
+    m_tombstones++;
+    atomic_store_release(&(m_chunks[entry->index >> NAME_REGISTRY_CHUNK_BITS][entry->index & NAME_REGISTRY_CHUNK_MASK]), static_cast<Entry *>(DTP_NULL));
+    m_liveCount--;
+    return entry;
+  }
+
+  /// Deletes entry returned by remove() and makes it's index available for reuse.
+  /// Caller must serialize it with inserts.
+  void release(Entry *entry)
+  {
+    m_memory -= entryCost(entry->name);
+    m_freeIndexes.push_back(entry->index);
+    delete entry->value;
+    delete entry;
+  }
+
+  /// Sets max number of entries and max memory used by registry (approximate, in bytes).
+  /// Zero means no limit.
+  void setLimits(uint maxSize, size_t maxMemory)
+  {
+    m_maxSize = ((maxSize == 0) || (maxSize > NAME_REGISTRY_MAX_SIZE)) ? NAME_REGISTRY_MAX_SIZE : maxSize;
+    m_maxMemory = maxMemory;
+  }
+
+  /// \return <true> if name can be added without exceeding limits.
+  /// \param extraMemory memory used by caller's structures related to registry (e.g. name index),
+  ///        included in memory limit
+  bool canInsert(const dtpString &name, size_t extraMemory = 0) const
+  {
+    if (m_liveCount >= m_maxSize)
+      return false;
+    return (m_maxMemory == 0) || (m_memory + extraMemory + insertCost(name) <= m_maxMemory);
+  }
+
+  /// Returns approximate number of bytes used by registry
+  size_t getMemoryUsage() const
+  {
+    return m_memory;
+  }
+
+  /// Returns number of indexes in use (upper bound for at()), including removed ones
+  uint size() const
+  {
+    return atomic_load_acquire(&m_count);
+  }
+
+  /// Returns index which will be used by next insert
+  uint nextIndex() const
+  {
+    return m_freeIndexes.empty() ? m_count : m_freeIndexes.back();
+  }
+
+  /// Returns number of registered (not removed) items
+  uint liveSize() const
+  {
+    return m_liveCount;
+  }
+
+  bool empty() const
+  {
+    return (m_liveCount == 0);
+  }
+
+  /// Returns entry with a given index, index must be lower than size().
+  /// Returns NULL for removed entries.
+  const Entry *at(uint index) const
+  {
+    assert(index < size());
+    Entry * volatile *chunk = atomic_load_acquire(&m_chunks[index >> NAME_REGISTRY_CHUNK_BITS]);
+    return atomic_load_acquire(&chunk[index & NAME_REGISTRY_CHUNK_MASK]);
+  }
+
+protected:
+  struct Table {
+    uint mask;
+    Entry * volatile *slots;
+  };
+
+  static Table *newTable(uint capacity)
+  {
+    Table *res = new Table();
+    res->mask = capacity - 1;
+    res->slots = new Entry *[capacity];
+    for(uint i=0; i != capacity; i++)
+      res->slots[i] = DTP_NULL;
+    return res;
+  }
+
+  /// Marks table slot of removed entry, lookups continue probing past it
+  static Entry *tombstone()
+  {
+    return reinterpret_cast<Entry *>(static_cast<size_t>(1));
+  }
+
+  static const Entry *findEntry(const Table *table, const dtpString &name, uint64 hash)
+  {
+    const Entry *entry;
+
+    for(uint i = static_cast<uint>(hash) & table->mask; ; i = (i + 1) & table->mask)
+    {
+      entry = atomic_load_acquire(&(table->slots[i]));
+      if (entry == DTP_NULL)
+        return DTP_NULL;
+      if ((entry != tombstone()) && (entry->hash == hash) && (entry->name == name))
+        return entry;
+    }
+  }
+
+  static size_t tableCost(uint capacity)
+  {
+    return sizeof(Table) + capacity * sizeof(Entry *);
+  }
+
+  /// Returns memory needed to insert name, including chunk & table growth
+  size_t insertCost(const dtpString &name) const
+  {
+    size_t res = entryCost(name);
+    if (m_freeIndexes.empty() && ((m_count & NAME_REGISTRY_CHUNK_MASK) == 0))
+      res += NAME_REGISTRY_CHUNK_SIZE * sizeof(Entry *);
+    if (needsGrow() && ((m_liveCount + 1) * 4 > m_table->mask + 1))
+      res += tableCost((m_table->mask + 1) * 2) - tableCost(m_table->mask + 1);
+    return res;
+  }
+
+  static size_t entryCost(const dtpString &name)
+  {
+    return sizeof(Entry) + name.size() + 1 + sizeof(T);
+  }
+
+  /// \return <true> if next insert would fill more than half of the table
+  bool needsGrow() const
+  {
+    return ((m_liveCount + m_tombstones + 1) * 2 > m_table->mask + 1);
+  }
+
+  static void deleteTable(Table *table)
+  {
+    delete [] table->slots;
+    delete table;
+  }
+
+  static void deleteTableFunc(void *table)
+  {
+    deleteTable(static_cast<Table *>(table));
+  }
+
+  /// Adds entry to first free slot on it's probe path
+  /// \return <true> if slot of removed entry has been reused
+  static bool addToTable(Table *table, Entry *entry)
+  {
+    uint i = static_cast<uint>(entry->hash) & table->mask;
+    while((table->slots[i] != DTP_NULL) && (table->slots[i] != tombstone()))
+      i = (i + 1) & table->mask;
+    bool res = (table->slots[i] != DTP_NULL);
+    atomic_store_release(&(table->slots[i]), entry);
+    return res;
+  }
+
+  /// Rebuilds table without tombstones, doubles capacity if needed
+  void grow()
+  {
+    Table *oldTable = m_table;
+    uint capacity = oldTable->mask + 1;
+    if ((m_liveCount + 1) * 4 > capacity)
+      capacity *= 2;
+
+    Table *table = newTable(capacity);
+    for(uint i=0, epos = oldTable->mask + 1; i != epos; i++)
+      if ((oldTable->slots[i] != DTP_NULL) && (oldTable->slots[i] != tombstone()))
+        addToTable(table, oldTable->slots[i]);
+
+    m_memory += tableCost(capacity);
+    m_tombstones = 0;
+    atomic_store_release(&m_table, table);
+    // readers can still use the old table
+    if (m_removable)
+    {
+      m_memory -= tableCost(oldTable->mask + 1);
+      Epoch::retire(oldTable, &NameRegistry::deleteTableFunc);
+    } else {
+      m_oldTables.push_back(oldTable);
+    }
+  }
+
+private:
+  // no copy
+  NameRegistry(const NameRegistry &);
+  NameRegistry &operator=(const NameRegistry &);
+private:
+  Table * volatile m_table;
+  // tables replaced by grow() in registry without removal
+  std::vector<Table *> m_oldTables;
+  bool m_removable;
+  Entry * volatile * volatile m_chunks[NAME_REGISTRY_MAX_CHUNKS];
+  volatile uint m_count;
+  uint m_liveCount;
+  uint m_tombstones;
+  std::vector<uint> m_freeIndexes;
+  std::vector<uint> m_generations;
+  uint m_maxSize;
+  size_t m_maxMemory;
+  size_t m_memory;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFNAMEREGISTRY_H__
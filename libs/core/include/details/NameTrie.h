@@ -0,0 +1,96 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        NameTrie.h
+// Project:     perfLib
+// Purpose:     Prefix index of hierarchical (dotted) names
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFNAMETRIE_H__
+#define _PERFNAMETRIE_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file NameTrie.h
+///
+/// Index of item names split into segments by '.', e.g. "db.pool.acquire"
+/// is stored as path db -> pool -> acquire. Each node keeps indexes of 
+/// items with a given name, so prefix queries cost time proportional to 
+/// the size of matching subtree.
+/// Not thread-safe, callers guard it with the same lock as their inserts.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <map>
+#include <vector>
+
+#include "perf/details/ptypes.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const char NAME_TRIE_SEPARATOR = '.';
+
+// ----------------------------------------------------------------------------
+// Functions
+// ----------------------------------------------------------------------------
+/// Characters which can have special meaning in wildcard patterns: '*', '?' and
+/// characters passed to regular expression (see CompiledFilter)
+const char * const WILDCARD_SPECIAL_CHARS = "*?[]{}()\\|+^$";
+
+/// Returns part of wildcard pattern before first special character
+inline dtpString wildcard_prefix(const dtpString &pattern)
+{
+  dtpString::size_type pos = pattern.find_first_of(WILDCARD_SPECIAL_CHARS);
+  return (pos == dtpString::npos) ? pattern : pattern.substr(0, pos);
+}
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+class NameTrie {
+public:
+  NameTrie();
+  ~NameTrie();
+  void insert(const dtpString &name, uint index);
+  /// Removes index of item with a given name, drops nodes left empty
+  void remove(const dtpString &name, uint index);
+  /// Appends indexes of all items with name starting with <prefix> to output.
+  /// Prefix does not have to end on segment boundary ("db.po" matches "db.pool.acquire").
+  void findByPrefix(const dtpString &prefix, std::vector<uint> &output) const;
+  void clear();
+  /// Returns approximate number of bytes used by nodes & indexes
+  size_t getMemoryUsage() const { return m_memory; }
+  /// Returns approximate number of bytes needed to insert name
+  size_t insertCost(const dtpString &name) const;
+protected:
+  struct Node;
+  typedef std::map<dtpString, Node *> NodeMap;
+  struct Node {
+    NodeMap children;
+    std::vector<uint> items;
+  };
+  static void collect(const Node *node, std::vector<uint> &output);
+  static void clearNode(Node *node);
+  static size_t nodeCost(const dtpString &segment);
+  /// \return <true> if node has no items and no children after removal
+  bool removeFrom(Node *node, const dtpString &name, dtpString::size_type start, uint index);
+private:
+  // no copy
+  NameTrie(const NameTrie &);
+  NameTrie &operator=(const NameTrie &);
+private:
+  Node m_root;
+  size_t m_memory;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFNAMETRIE_H__
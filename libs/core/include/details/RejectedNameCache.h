@@ -0,0 +1,157 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        RejectedNameCache.h
+// Project:     perfLib
+// Purpose:     Bounded set of names rejected by registry limits
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFREJECTEDNAMECACHE_H__
+#define _PERFREJECTEDNAMECACHE_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file RejectedNameCache.h
+///
+/// Names which did not fit into a registry (see NameRegistry::canInsert).
+/// Repeated uses of a rejected name are found here without a lock, so they
+/// can be routed to the overflow item without entering the insert lock,
+/// and each name is counted as rejected once.
+///
+/// - lookups (contains) do not take any lock
+/// - inserts & clear must be serialized by caller
+/// - size & memory are bounded, names above the bound are not cached - 
+///   isOverflowing() tells owner to route all new names to overflow item
+///   without the insert lock until registry frees an item or limits change
+/// - clear() publishes a new, empty set and retires the old one with Epoch
+/// - removals from registry do not clear the cache one by one, rejected
+///   names are retried once the freed capacity is worth it (see release())
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include "perf/details/ptypes.h"
+#include "perf/details/atomic_ops.h"
+#include "perf/details/Epoch.h"
+#include "perf/details/NameRegistry.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// Max number of cached rejected names
+const uint REJECTED_NAME_CACHE_SIZE = 4096;
+/// Max memory of cached rejected names (approximate, in bytes)
+const size_t REJECTED_NAME_CACHE_MEMORY = 1024 * 1024;
+/// Cache is cleared after removals freed 1/N of number of cached names
+const uint REJECTED_NAME_CACHE_RETRY_RATIO = 16;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+class RejectedNameCache {
+public:
+  RejectedNameCache(): m_freed(0), m_overflowing(0)
+  {
+    m_names = newNames();
+  }
+
+  ~RejectedNameCache()
+  {
+    delete m_names;
+  }
+
+  /// \return <true> if name is cached as rejected
+  bool contains(const dtpString &name, uint64 hash) const
+  {
+    // set can be retired by clear() in the meantime
+    EpochGuard guard;
+    return (atomic_load_acquire(&m_names)->find(name, hash) != DTP_NULL);
+  }
+
+  /// \return <true> if a name could not be cached since last clear() or release()
+  bool isOverflowing() const
+  {
+    return (atomic_load(&m_overflowing) != 0);
+  }
+
+  /// Adds name to cache. Caller must serialize inserts and make sure name is not cached yet.
+  /// \return <false> if cache is full, name is not cached then and cache is overflowing
+  bool insert(const dtpString &name, uint64 hash)
+  {
+    if (!m_names->canInsert(name))
+    {
+      atomic_store(&m_overflowing, 1U);
+      return false;
+    }
+    m_names->insert(name, hash, new uint(0));
+    return true;
+  }
+
+  /// Notifies cache that registry freed one item. Clears cache when
+  /// enough capacity was freed, so churn at full registry does not
+  /// drop all rejected names on each removal.
+  /// Caller must serialize it with inserts.
+  void release()
+  {
+    // new names can fit now
+    atomic_store(&m_overflowing, 0U);
+    if (m_names->empty())
+      return;
+    uint limit = m_names->liveSize() / REJECTED_NAME_CACHE_RETRY_RATIO;
+    if (++m_freed >= ((limit != 0) ? limit : 1))
+      clear();
+  }
+
+  /// Removes all names, e.g. when registry limits changed. 
+  /// Caller must serialize it with inserts.
+  void clear()
+  {
+    m_freed = 0;
+    atomic_store(&m_overflowing, 0U);
+    if (m_names->empty())
+      return;
+    Names *names = m_names;
+    atomic_store_release(&m_names, newNames());
+    Epoch::retire(names, &RejectedNameCache::deleteNamesFunc);
+  }
+
+  uint size() const
+  {
+    return m_names->liveSize();
+  }
+
+protected:
+  typedef NameRegistry<uint> Names;
+
+  static Names *newNames()
+  {
+    Names *res = new Names();
+    res->setLimits(REJECTED_NAME_CACHE_SIZE, REJECTED_NAME_CACHE_MEMORY);
+    return res;
+  }
+
+  static void deleteNamesFunc(void *names)
+  {
+    delete static_cast<Names *>(names);
+  }
+
+private:
+  // no copy
+  RejectedNameCache(const RejectedNameCache &);
+  RejectedNameCache &operator=(const RejectedNameCache &);
+private:
+  Names * volatile m_names;
+  /// Number of items freed in registry since last clear
+  uint m_freed;
+  volatile uint m_overflowing;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFREJECTEDNAMECACHE_H__
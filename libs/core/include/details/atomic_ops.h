@@ -0,0 +1,144 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        atomic_ops.h
+// Project:     perfLib
+// Purpose:     Minimal atomic operations on plain integer & pointer types
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFATOMICOPS_H__
+#define _PERFATOMICOPS_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file atomic_ops.h
+///
+/// Minimal set of atomic operations working on plain (aligned) variables,
+/// so they can be used on arrays, memory-mapped blocks and C++98 compilers.
+/// Supported types: 32 & 64-bit integers and pointers.
+///
+/// Functions without ordering suffix are "relaxed" - they only guarantee
+/// that value is not torn. Read-modify-write functions are full barriers.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "perf/details/ptypes.h"
+
+namespace perf {
+namespace Details {
+
+#if defined(_MSC_VER)
+// ----------------------------------------------------------------------------
+// MSVC: volatile access has acquire / release semantics on x86 & x64
+// ----------------------------------------------------------------------------
+template<typename T>
+inline T atomic_load(const volatile T *ptr) { return *ptr; }
+
+template<typename T>
+inline T atomic_load_acquire(const volatile T *ptr) { return *ptr; }
+
+template<typename T>
+inline void atomic_store(volatile T *ptr, T value) { *ptr = value; }
+
+template<typename T>
+inline void atomic_store_release(volatile T *ptr, T value) { *ptr = value; }
+
+template<typename T>
+inline T atomic_fetch_add(volatile T *ptr, T value)
+{
+  if (sizeof(T) == 8)
+    return static_cast<T>(_InterlockedExchangeAdd64(reinterpret_cast<volatile __int64 *>(ptr), static_cast<__int64>(value)));
+  else
+    return static_cast<T>(_InterlockedExchangeAdd(reinterpret_cast<volatile long *>(ptr), static_cast<long>(value)));
+}
+
+template<typename T>
+inline T atomic_exchange(volatile T *ptr, T value)
+{
+  if (sizeof(T) == 8)
+    return (T)(_InterlockedExchange64(reinterpret_cast<volatile __int64 *>(ptr), (__int64)(value)));
+  else
+    return (T)(_InterlockedExchange(reinterpret_cast<volatile long *>(ptr), (long)(value)));
+}
+
+template<typename T>
+inline T atomic_fetch_or(volatile T *ptr, T value)
+{
+  if (sizeof(T) == 8)
+    return static_cast<T>(_InterlockedOr64(reinterpret_cast<volatile __int64 *>(ptr), static_cast<__int64>(value)));
+  else
+    return static_cast<T>(_InterlockedOr(reinterpret_cast<volatile long *>(ptr), static_cast<long>(value)));
+}
+
+/// \return <true> if value was equal to <expected> and has been replaced
+template<typename T>
+inline bool atomic_cas(volatile T *ptr, T expected, T desired)
+{
+  if (sizeof(T) == 8)
+    return _InterlockedCompareExchange64(reinterpret_cast<volatile __int64 *>(ptr), (__int64)(desired), (__int64)(expected)) == (__int64)(expected);
+  else
+    return _InterlockedCompareExchange(reinterpret_cast<volatile long *>(ptr), (long)(desired), (long)(expected)) == (long)(expected);
+}
+
+inline void atomic_thread_fence()
+{
+  MemoryBarrier();
+}
+
+#else
+// ----------------------------------------------------------------------------
+// GCC & clang
+// ----------------------------------------------------------------------------
+template<typename T>
+inline T atomic_load(const volatile T *ptr) { return __atomic_load_n(ptr, __ATOMIC_RELAXED); }
+
+template<typename T>
+inline T atomic_load_acquire(const volatile T *ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+
+template<typename T>
+inline void atomic_store(volatile T *ptr, T value) { __atomic_store_n(ptr, value, __ATOMIC_RELAXED); }
+
+template<typename T>
+inline void atomic_store_release(volatile T *ptr, T value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+
+template<typename T>
+inline T atomic_fetch_add(volatile T *ptr, T value) { return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST); }
+
+template<typename T>
+inline T atomic_exchange(volatile T *ptr, T value) { return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST); }
+
+template<typename T>
+inline T atomic_fetch_or(volatile T *ptr, T value) { return __atomic_fetch_or(ptr, value, __ATOMIC_SEQ_CST); }
+
+/// \return <true> if value was equal to <expected> and has been replaced
+template<typename T>
+inline bool atomic_cas(volatile T *ptr, T expected, T desired)
+{
+  return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+inline void atomic_thread_fence()
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+#endif
+
+/// Increments variable which is written by a single thread only, but can be read
+/// concurrently by other threads. Cheaper than atomic_fetch_add (no bus lock).
+template<typename T>
+inline void atomic_add_single_writer(volatile T *ptr, T value)
+{
+  atomic_store(ptr, static_cast<T>(atomic_load(ptr) + value));
+}
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFATOMICOPS_H__
@@ -0,0 +1,82 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        platform.h
+// Project:     perfLib
+// Purpose:     Compiler & platform specific definitions
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFPLATFORM_H__
+#define _PERFPLATFORM_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file platform.h
+///
+/// Compiler & platform specific definitions used by perf libraries.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <cstdlib>
+#include <cstring>
+
+#include "perf/details/ptypes.h"
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// Size of CPU cache line, used to keep per-thread data apart
+#define PERF_CACHE_LINE_SIZE 64
+
+// ----------------------------------------------------------------------------
+// Compiler specific macros
+// ----------------------------------------------------------------------------
+#if defined(_MSC_VER)
+#define PERF_THREAD_LOCAL __declspec(thread)
+#define PERF_LIKELY(a) (a)
+#define PERF_UNLIKELY(a) (a)
+#else
+#define PERF_THREAD_LOCAL __thread
+#define PERF_LIKELY(a) __builtin_expect(!!(a), 1)
+#define PERF_UNLIKELY(a) __builtin_expect(!!(a), 0)
+#endif
+
+#if (__cplusplus >= 201103L) || (defined(_MSC_VER) && (_MSC_VER >= 1900))
+#define PERF_HAS_CONSTEXPR
+#endif
+
+namespace perf {
+namespace Details {
+
+/// Allocates zero-filled memory block aligned to cache line
+inline void *alloc_cache_aligned(size_t size)
+{
+  void *res;
+#if defined(_MSC_VER)
+  res = _aligned_malloc(size, PERF_CACHE_LINE_SIZE);
+#else
+  if (posix_memalign(&res, PERF_CACHE_LINE_SIZE, size) != 0)
+    res = DTP_NULL;
+#endif
+  if (res != DTP_NULL)
+    memset(res, 0, size);
+  return res;
+}
+
+/// Releases memory allocated with alloc_cache_aligned
+inline void free_cache_aligned(void *ptr)
+{
+#if defined(_MSC_VER)
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFPLATFORM_H__
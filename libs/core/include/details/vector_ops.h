@@ -0,0 +1,57 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        vector_ops.h
+// Project:     perfLib
+// Purpose:     Element-wise operations on arrays of 64-bit values
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFVECTOROPS_H__
+#define _PERFVECTOROPS_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file vector_ops.h
+///
+/// Element-wise add of uint64 arrays, using SSE2 where available.
+/// Arrays can be shared with readers using atomic_load on single elements:
+/// each element is 8-byte aligned, so it is always written as a whole.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define PERF_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "perf/details/ptypes.h"
+
+namespace perf {
+namespace Details {
+
+/// Adds input[i] to output[i] for i in [0, count)
+inline void add_vector(uint64 *output, const uint64 *input, uint count)
+{
+  uint i = 0;
+#ifdef PERF_HAS_SSE2
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(output + i));
+    __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(output + i + 2));
+    __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+    __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i + 2));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_add_epi64(a0, b0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i + 2), _mm_add_epi64(a1, b1));
+  }
+#endif
+  for(; i != count; i++)
+    output[i] += input[i];
+}
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFVECTOROPS_H__
@@ -0,0 +1,250 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CompiledFilter.cpp
+// Project:     perfLib
+// Purpose:     Set of wildcard patterns matched in a single pass
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "boost/regex.hpp"
+
+#include "perf/CompiledFilter.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+
+// ----------------------------------------------------------------------------
+// Local definitions
+// ----------------------------------------------------------------------------
+// state with no positions - nothing can match anymore
+const uint FILTER_DEAD_STATE = 0;
+const uint FILTER_CHAR_COUNT = 256;
+
+namespace perf {
+namespace Details {
+
+/// Pattern which is not simple, converted to regular expression: '*' - any sequence,
+/// '?' - any character, '.' - dot, other characters are passed as they are
+class RegexMatcher {
+public:
+  explicit RegexMatcher(const dtpString &pattern): m_regex(toRegex(pattern)) {}
+  bool isMatching(const dtpString &name) const { return boost::regex_match(name, m_regex); }
+protected:
+  static dtpString toRegex(const dtpString &pattern)
+  {
+    dtpString res;
+    for(dtpString::size_type i=0, epos = pattern.size(); i != epos; i++)
+    {
+      switch(pattern[i]) {
+        case '*':
+          res += ".*";
+          break;
+        case '?':
+          res += '.';
+          break;
+        case '.':
+          res += "\\.";
+          break;
+        default:
+          res += pattern[i];
+      }
+    }
+    return res;
+  }
+private:
+  boost::regex m_regex;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+// ----------------------------------------------------------------------------
+// CompiledFilter
+// ----------------------------------------------------------------------------
+CompiledFilter::CompiledFilter()
+{
+  m_compiled = false;
+  m_startState = FILTER_DEAD_STATE;
+  m_clockHand = 0;
+}
+
+CompiledFilter::~CompiledFilter()
+{
+}
+
+void CompiledFilter::addPattern(const dtpString &pattern)
+{
+  m_patterns.push_back(pattern);
+  if (!isSimplePattern(pattern))
+    m_matchers.push_back(new Details::RegexMatcher(pattern));
+  invalidate();
+}
+
+void CompiledFilter::clear()
+{
+  m_patterns.clear();
+  m_matchers.clear();
+  invalidate();
+}
+
+bool CompiledFilter::isSimplePattern(const dtpString &pattern)
+{
+  dtpString::size_type pos = pattern.find_first_of(Details::WILDCARD_SPECIAL_CHARS);
+  while(pos != dtpString::npos)
+  {
+    if ((pattern[pos] != '*') && (pattern[pos] != '?'))
+      return false;
+    pos = pattern.find_first_of(Details::WILDCARD_SPECIAL_CHARS, pos + 1);
+  }
+  return true;
+}
+
+void CompiledFilter::invalidate()
+{
+  m_compiled = false;
+  m_cache.clear();
+  m_clockHand = 0;
+}
+
+bool CompiledFilter::isMatching(const dtpString &name)
+{
+  CacheEntry *cached = m_cache.find(name);
+  if (cached != DTP_NULL)
+  {
+    cached->referenced = true;
+    return cached->matching;
+  }
+
+  bool res = match(name);
+  if (m_cache.size() < COMPILED_FILTER_MAX_CACHE)
+    m_cache.get(name).matching = res;
+  else
+    m_cache.replace(findVictim(), name).matching = res;
+  return res;
+}
+
+// Returns position of cached name to be replaced, names used since last pass get a second chance
+uint CompiledFilter::findVictim()
+{
+  for(;;)
+  {
+    if (m_clockHand >= m_cache.size())
+      m_clockHand = 0;
+    CacheEntry &entry = m_cache.valueAt(m_clockHand++);
+    if (!entry.referenced)
+      return m_clockHand - 1;
+    entry.referenced = false;
+  }
+}
+
+void CompiledFilter::compile()
+{
+  m_positions.clear();
+  m_states.clear();
+  m_accepting.clear();
+  m_stateMap.clear();
+  m_next.clear();
+
+  PositionSet positions;
+  addState(positions);
+
+  for(uint i=0, epos = m_patterns.size(); i != epos; i++)
+  {
+    if (!isSimplePattern(m_patterns[i]))
+      continue;
+    positions.push_back(m_positions.size());
+    m_positions += m_patterns[i];
+    m_positions += '\0';
+  }
+
+  addClosure(positions);
+  m_startState = addState(positions);
+  m_compiled = true;
+}
+
+bool CompiledFilter::match(const dtpString &name)
+{
+  if (!m_compiled || (m_states.size() > COMPILED_FILTER_MAX_STATES))
+    compile();
+
+  uint state = m_startState;
+  for(dtpString::size_type i=0, epos = name.size(); i != epos; i++)
+  {
+    state = getNextState(state, static_cast<unsigned char>(name[i]));
+    if (state == FILTER_DEAD_STATE)
+      break;
+  }
+
+  if (m_accepting[state])
+    return true;
+
+  for(uint i=0, epos = m_matchers.size(); i != epos; i++)
+    if (m_matchers[i].isMatching(name))
+      return true;
+
+  return false;
+}
+
+uint CompiledFilter::getNextState(uint state, unsigned char c)
+{
+  int next = m_next[state * FILTER_CHAR_COUNT + c];
+  if (next >= 0)
+    return static_cast<uint>(next);
+
+  PositionSet positions;
+  char posChar;
+  for(uint i=0, epos = m_states[state].size(); i != epos; i++)
+  {
+    uint pos = m_states[state][i];
+    posChar = m_positions[pos];
+    if (posChar == '*')
+      positions.push_back(pos);
+    else if ((posChar != '\0') && ((posChar == '?') || (posChar == static_cast<char>(c))))
+      positions.push_back(pos + 1);
+  }
+
+  addClosure(positions);
+  uint res = addState(positions);
+  m_next[state * FILTER_CHAR_COUNT + c] = static_cast<int>(res);
+  return res;
+}
+
+// Adds positions reachable without consuming a character (after '*'), sorts the set
+void CompiledFilter::addClosure(PositionSet &positions) const
+{
+  for(uint i=0; i != positions.size(); i++)
+    if (m_positions[positions[i]] == '*')
+      positions.push_back(positions[i] + 1);
+
+  std::sort(positions.begin(), positions.end());
+  positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+}
+
+// Returns state for a given (sorted) set of positions, adds it if needed
+uint CompiledFilter::addState(const PositionSet &positions)
+{
+  StateMap::iterator it = m_stateMap.find(positions);
+  if (it != m_stateMap.end())
+    return it->second;
+
+  uint res = m_states.size();
+  bool accepting = false;
+  for(uint i=0, epos = positions.size(); i != epos; i++)
+    if (m_positions[positions[i]] == '\0')
+    {
+      accepting = true;
+      break;
+    }
+
+  m_states.push_back(positions);
+  m_accepting.push_back(accepting);
+  m_next.resize(m_next.size() + FILTER_CHAR_COUNT, -1);
+  m_stateMap.insert(StateMap::value_type(positions, res));
+  return res;
+}
@@ -0,0 +1,158 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        DirtyTracker.cpp
+// Project:     perfLib
+// Purpose:     Tracks indexes of items changed since a given generation
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <new>
+#include <algorithm>
+
+#include "perf/details/DirtyTracker.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// DirtyTracker
+// ----------------------------------------------------------------------------
+DirtyTracker::DirtyTracker()
+{
+  for(uint i=0; i != DIRTY_MAX_CHUNKS; i++)
+    m_chunks[i] = DTP_NULL;
+  for(uint i=0; i != DIRTY_MAX_CHUNKS / 64; i++)
+    m_summary[i] = 0;
+  m_generation = 1;
+  m_firstGeneration = m_generation + 1;
+}
+
+DirtyTracker::~DirtyTracker()
+{
+  for(uint i=0; i != DIRTY_MAX_CHUNKS; i++)
+    if (m_chunks[i] != DTP_NULL)
+      free_cache_aligned(const_cast<uint64 *>(m_chunks[i]));
+}
+
+void DirtyTracker::markSlow(uint index, uint64 bits)
+{
+  uint chunkIdx = index >> DIRTY_CHUNK_BITS;
+  volatile uint64 *chunk = atomic_load_acquire(&m_chunks[chunkIdx]);
+  if (chunk == DTP_NULL)
+  {
+    volatile uint64 *newChunk = static_cast<volatile uint64 *>(alloc_cache_aligned(DIRTY_CHUNK_WORDS * sizeof(uint64)));
+    if (newChunk == DTP_NULL)
+      throw std::bad_alloc();
+    if (atomic_cas(&m_chunks[chunkIdx], static_cast<volatile uint64 *>(DTP_NULL), newChunk))
+      chunk = newChunk;
+    else {
+      // other thread was faster
+      free_cache_aligned(const_cast<uint64 *>(newChunk));
+      chunk = atomic_load_acquire(&m_chunks[chunkIdx]);
+    }
+  }
+
+  // word bits first - collect() clears summary before words
+  atomic_fetch_or(&chunk[(index & (DIRTY_CHUNK_SIZE - 1)) >> 6], bits);
+  atomic_fetch_or(&m_summary[chunkIdx >> 6], static_cast<uint64>(1) << (chunkIdx & 63));
+}
+
+void DirtyTracker::markRange(uint first, uint count)
+{
+  assert(first + count <= DIRTY_MAX_SIZE);
+  uint bitIdx, cnt;
+  uint64 mask;
+  volatile uint64 *chunk;
+
+  // see mark()
+  atomic_thread_fence();
+
+  while(count > 0)
+  {
+    bitIdx = first & 63;
+    cnt = 64 - bitIdx;
+    if (cnt > count)
+      cnt = count;
+    mask = ((cnt == 64) ? ~static_cast<uint64>(0) : ((static_cast<uint64>(1) << cnt) - 1)) << bitIdx;
+
+    chunk = atomic_load_acquire(&m_chunks[first >> DIRTY_CHUNK_BITS]);
+    if ((chunk == DTP_NULL) || ((atomic_load(&chunk[(first & (DIRTY_CHUNK_SIZE - 1)) >> 6]) & mask) != mask))
+      markSlow(first, mask);
+
+    first += cnt;
+    count -= cnt;
+  }
+}
+
+void DirtyTracker::collect(std::vector<uint> &output)
+{
+  uint64 summary, word;
+  uint chunkIdx;
+  volatile uint64 *chunk;
+
+  for(uint s=0; s != DIRTY_MAX_CHUNKS / 64; s++)
+  {
+    if (atomic_load(&m_summary[s]) == 0)
+      continue;
+    summary = atomic_exchange(&m_summary[s], static_cast<uint64>(0));
+
+    for(uint sb=0; summary != 0; sb++, summary >>= 1)
+    {
+      if ((summary & 1) == 0)
+        continue;
+
+      chunkIdx = (s << 6) + sb;
+      chunk = atomic_load_acquire(&m_chunks[chunkIdx]);
+      for(uint w=0; w != DIRTY_CHUNK_WORDS; w++)
+      {
+        if (atomic_load(&chunk[w]) == 0)
+          continue;
+        word = atomic_exchange(&chunk[w], static_cast<uint64>(0));
+        for(uint b=0; word != 0; b++, word >>= 1)
+          if ((word & 1) != 0)
+            output.push_back((chunkIdx << DIRTY_CHUNK_BITS) + (w << 6) + b);
+      }
+    }
+  }
+}
+
+uint64 DirtyTracker::getChanged(uint64 since, std::vector<uint> &output, bool &complete)
+{
+  uint64 res;
+  size_t outputBase = output.size();
+
+#pragma omp critical(perf_dirty)
+{
+  m_history.push_back(Round());
+  Round &round = m_history.back();
+  collect(round.indexes);
+  if (round.indexes.empty())
+    m_history.pop_back();
+  else
+  {
+    round.generation = ++m_generation;
+    while(m_history.size() > DIRTY_HISTORY_SIZE)
+      m_history.pop_front();
+    m_firstGeneration = m_history.front().generation;
+  }
+
+  res = m_generation;
+  // all rounds after <since> must still be in history, otherwise reader fell behind
+  complete = (since + 1 >= m_firstGeneration) || (since >= m_generation);
+  if (complete)
+  {
+    for(std::deque<Round>::const_iterator it = m_history.begin(), epos = m_history.end(); it != epos; ++it)
+      if (it->generation > since)
+        output.insert(output.end(), it->indexes.begin(), it->indexes.end());
+  }
+}
+
+  std::sort(output.begin() + outputBase, output.end());
+  output.erase(std::unique(output.begin() + outputBase, output.end()), output.end());
+  return res;
+}
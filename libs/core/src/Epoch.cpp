@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        Epoch.cpp
+// Project:     perfLib
+// Purpose:     Epoch-based reclamation of objects shared with lock-free readers
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <new>
+
+#include "boost/thread/tss.hpp"
+
+#include "perf/details/Epoch.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// Epoch
+// ----------------------------------------------------------------------------
+PERF_THREAD_LOCAL EpochRecord *Epoch::m_current = DTP_NULL;
+EpochRecord *volatile Epoch::m_records = DTP_NULL;
+volatile uint64 Epoch::m_global = 1;
+Epoch::RetiredColn Epoch::m_retired;
+volatile uint Epoch::m_pending = 0;
+
+EpochRecord *Epoch::attach()
+{
+  EpochRecord *res = DTP_NULL;
+#pragma omp critical(perf_epoch)
+{
+  // owner of thread's record, calls detach() on thread exit
+  static boost::thread_specific_ptr<EpochRecord> owner(&Epoch::detach);
+
+  for(EpochRecord *rec = m_records; rec != DTP_NULL; rec = rec->next)
+    if (rec->used == 0)
+    {
+      res = rec;
+      break;
+    }
+
+  if (res == DTP_NULL)
+  {
+    res = static_cast<EpochRecord *>(alloc_cache_aligned(sizeof(EpochRecord)));
+    if (res != DTP_NULL)
+    {
+      res->next = m_records;
+      atomic_store_release(&m_records, res);
+    }
+  }
+
+  if (res != DTP_NULL)
+  {
+    res->used = 1;
+    res->depth = 0;
+    owner.reset(res);
+  }
+}
+  if (res == DTP_NULL)
+    throw std::bad_alloc();
+  m_current = res;
+  return res;
+}
+
+void Epoch::detach(EpochRecord *rec)
+{
+  // records are never freed - readers of the list do not lock it
+#pragma omp critical(perf_epoch)
+{
+  atomic_store_release(&rec->state, static_cast<uint64>(0));
+  rec->depth = 0;
+  rec->used = 0;
+}
+  if (m_current == rec)
+    m_current = DTP_NULL;
+}
+
+void Epoch::retire(void *ptr, EpochDeleter deleter)
+{
+  Retired item;
+  item.ptr = ptr;
+  item.deleter = deleter;
+
+#pragma omp critical(perf_epoch)
+{
+  item.epoch = atomic_load(&m_global);
+  m_retired.push_back(item);
+  atomic_store(&m_pending, static_cast<uint>(m_retired.size()));
+}
+}
+
+bool Epoch::tryAdvance()
+{
+  uint64 global = atomic_load(&m_global);
+  uint64 state;
+
+  atomic_thread_fence();
+  for(EpochRecord *rec = atomic_load_acquire(&m_records); rec != DTP_NULL; rec = rec->next)
+  {
+    state = atomic_load_acquire(&rec->state);
+    if (((state & 1) != 0) && ((state >> 1) != global))
+      return false;
+  }
+
+  atomic_store_release(&m_global, global + 1);
+  return true;
+}
+
+uint Epoch::reclaim()
+{
+  RetiredColn ready;
+
+#pragma omp critical(perf_epoch)
+{
+  for(uint round=0; (round != EPOCH_RECLAIM_ROUNDS) && !m_retired.empty(); round++)
+  {
+    if (!tryAdvance())
+      break;
+
+    // object retired in epoch E can be used by readers of E and E + 1 only
+    uint64 global = atomic_load(&m_global);
+    uint j = 0;
+    for(uint i=0, epos = m_retired.size(); i != epos; i++)
+    {
+      if (m_retired[i].epoch + 2 <= global)
+        ready.push_back(m_retired[i]);
+      else
+        m_retired[j++] = m_retired[i];
+    }
+    m_retired.resize(j);
+  }
+  atomic_store(&m_pending, static_cast<uint>(m_retired.size()));
+}
+
+  for(uint i=0, epos = ready.size(); i != epos; i++)
+    ready[i].deleter(ready[i].ptr);
+  return ready.size();
+}
+
+uint Epoch::getPendingCount()
+{
+  uint res;
+#pragma omp critical(perf_epoch)
+  res = m_retired.size();
+  return res;
+}
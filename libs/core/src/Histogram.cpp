@@ -0,0 +1,215 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        Histogram.cpp
+// Project:     perfLib
+// Purpose:     Log-linear histogram of recorded values
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "perf/Histogram.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+
+// ----------------------------------------------------------------------------
+// Local functions
+// ----------------------------------------------------------------------------
+// returns index of highest bit set, value must be non-zero
+static inline uint highest_bit(uint64 value)
+{
+#if defined(_MSC_VER)
+  unsigned long res;
+  _BitScanReverse64(&res, value);
+  return res;
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+static inline void update_min(volatile uint64 *target, uint64 value)
+{
+  uint64 curr = Details::atomic_load(target);
+  while((value < curr) && !Details::atomic_cas(target, curr, value))
+    curr = Details::atomic_load(target);
+}
+
+static inline void update_max(volatile uint64 *target, uint64 value)
+{
+  uint64 curr = Details::atomic_load(target);
+  while((value > curr) && !Details::atomic_cas(target, curr, value))
+    curr = Details::atomic_load(target);
+}
+
+// ----------------------------------------------------------------------------
+// Histogram
+// ----------------------------------------------------------------------------
+Histogram::Histogram()
+{
+  reset();
+}
+
+uint Histogram::getBucketIndex(uint64 value)
+{
+  if (value < HISTOGRAM_SUB_BUCKET_COUNT)
+    return static_cast<uint>(value);
+
+  uint shift = highest_bit(value) - HISTOGRAM_SUB_BUCKET_BITS;
+  uint sub = static_cast<uint>(value >> shift) - HISTOGRAM_SUB_BUCKET_COUNT;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKET_COUNT + sub;
+}
+
+uint64 Histogram::getBucketLowerBound(uint index)
+{
+  if (index < HISTOGRAM_SUB_BUCKET_COUNT)
+    return index;
+
+  uint shift = index / HISTOGRAM_SUB_BUCKET_COUNT - 1;
+  uint64 sub = index % HISTOGRAM_SUB_BUCKET_COUNT;
+  return (HISTOGRAM_SUB_BUCKET_COUNT + sub) << shift;
+}
+
+uint64 Histogram::getBucketUpperBound(uint index)
+{
+  if (index + 1 >= HISTOGRAM_BUCKET_COUNT)
+    return ~static_cast<uint64>(0);
+  return getBucketLowerBound(index + 1) - 1;
+}
+
+void Histogram::record(uint64 value)
+{
+  Details::atomic_fetch_add(&m_counts[getBucketIndex(value)], static_cast<uint64>(1));
+  Details::atomic_fetch_add(&m_sum, value);
+  update_min(&m_min, value);
+  update_max(&m_max, value);
+}
+
+void Histogram::recordSingleWriter(uint64 value)
+{
+  Details::atomic_add_single_writer(&m_counts[getBucketIndex(value)], static_cast<uint64>(1));
+  Details::atomic_add_single_writer(&m_sum, value);
+  if (value < Details::atomic_load(&m_min))
+    Details::atomic_store(&m_min, value);
+  if (value > Details::atomic_load(&m_max))
+    Details::atomic_store(&m_max, value);
+}
+
+void Histogram::merge(const Histogram &src)
+{
+  uint64 value;
+  for(uint i=0; i != HISTOGRAM_BUCKET_COUNT; i++)
+  {
+    value = Details::atomic_load(&src.m_counts[i]);
+    if (value != 0)
+      Details::atomic_fetch_add(&m_counts[i], value);
+  }
+  Details::atomic_fetch_add(&m_sum, src.getSum());
+  update_min(&m_min, Details::atomic_load(&src.m_min));
+  update_max(&m_max, Details::atomic_load(&src.m_max));
+}
+
+void Histogram::reset()
+{
+  for(uint i=0; i != HISTOGRAM_BUCKET_COUNT; i++)
+    Details::atomic_store(&m_counts[i], static_cast<uint64>(0));
+  Details::atomic_store(&m_sum, static_cast<uint64>(0));
+  Details::atomic_store(&m_min, ~static_cast<uint64>(0));
+  Details::atomic_store(&m_max, static_cast<uint64>(0));
+}
+
+uint64 Histogram::getCount() const
+{
+  uint64 res = 0;
+  for(uint i=0; i != HISTOGRAM_BUCKET_COUNT; i++)
+    res += Details::atomic_load(&m_counts[i]);
+  return res;
+}
+
+uint64 Histogram::getMin() const
+{
+  uint64 res = Details::atomic_load(&m_min);
+  return (res == ~static_cast<uint64>(0)) ? 0 : res;
+}
+
+uint64 Histogram::getMax() const
+{
+  return Details::atomic_load(&m_max);
+}
+
+uint64 Histogram::getPercentile(double percent) const
+{
+  uint64 count = getCount();
+  if (count == 0)
+    return 0;
+
+  uint64 target = static_cast<uint64>(static_cast<double>(count) * percent / 100.0 + 0.5);
+  if (target < 1)
+    target = 1;
+  if (target > count)
+    target = count;
+
+  uint64 sum = 0;
+  uint64 res = getMax();
+  for(uint i=0; i != HISTOGRAM_BUCKET_COUNT; i++)
+  {
+    sum += Details::atomic_load(&m_counts[i]);
+    if (sum >= target)
+    {
+      uint64 upper = getBucketUpperBound(i);
+      if (upper < res)
+        res = upper;
+      break;
+    }
+  }
+
+  return res;
+}
+
+void Histogram::getStats(HistogramStats &output) const
+{
+  const double percents[] = {50.0, 90.0, 99.0, 99.9};
+  uint64 *results[] = {&output.p50, &output.p90, &output.p99, &output.p999};
+  const uint percentCount = 4;
+  uint64 targets[percentCount];
+
+  output.count = getCount();
+  output.sum = getSum();
+  output.min = getMin();
+  output.max = getMax();
+
+  for(uint j=0; j != percentCount; j++)
+  {
+    *results[j] = 0;
+    targets[j] = static_cast<uint64>(static_cast<double>(output.count) * percents[j] / 100.0 + 0.5);
+    if (targets[j] < 1)
+      targets[j] = 1;
+  }
+
+  if (output.count == 0)
+    return;
+
+  // single pass for all percentiles
+  uint64 sum = 0;
+  uint j = 0;
+  for(uint i=0; (i != HISTOGRAM_BUCKET_COUNT) && (j != percentCount); i++)
+  {
+    sum += Details::atomic_load(&m_counts[i]);
+    while((j != percentCount) && (sum >= targets[j]))
+    {
+      uint64 upper = getBucketUpperBound(i);
+      *results[j] = (upper < output.max) ? upper : output.max;
+      j++;
+    }
+  }
+
+  // buckets changed after count was taken
+  for(; j != percentCount; j++)
+    *results[j] = output.max;
+}
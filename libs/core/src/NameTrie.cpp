@@ -0,0 +1,174 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        NameTrie.cpp
+// Project:     perfLib
+// Purpose:     Prefix index of hierarchical (dotted) names
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "perf/details/NameTrie.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// Local definitions
+// ----------------------------------------------------------------------------
+// Approximate cost of std::map node (links & color) besides it's value
+const size_t NAME_TRIE_MAP_NODE_COST = 4 * sizeof(void *);
+
+// ----------------------------------------------------------------------------
+// NameTrie
+// ----------------------------------------------------------------------------
+NameTrie::NameTrie()
+{
+  m_memory = 0;
+}
+
+NameTrie::~NameTrie()
+{
+  clearNode(&m_root);
+}
+
+void NameTrie::clear()
+{
+  clearNode(&m_root);
+  m_memory = 0;
+}
+
+size_t NameTrie::nodeCost(const dtpString &segment)
+{
+  return sizeof(Node) + sizeof(NodeMap::value_type) + NAME_TRIE_MAP_NODE_COST + segment.size() + 1;
+}
+
+size_t NameTrie::insertCost(const dtpString &name) const
+{
+  const Node *node = &m_root;
+  dtpString::size_type start = 0, pos;
+  dtpString segment;
+  size_t res = sizeof(uint);
+
+  do {
+    pos = name.find(NAME_TRIE_SEPARATOR, start);
+    segment = name.substr(start, (pos == dtpString::npos) ? dtpString::npos : pos - start);
+
+    if (node != DTP_NULL)
+    {
+      NodeMap::const_iterator it = node->children.find(segment);
+      node = (it == node->children.end()) ? DTP_NULL : it->second;
+    }
+    // all segments below first missing one are new
+    if (node == DTP_NULL)
+      res += nodeCost(segment);
+    start = pos + 1;
+  } while(pos != dtpString::npos);
+
+  return res;
+}
+
+void NameTrie::clearNode(Node *node)
+{
+  for(NodeMap::iterator it = node->children.begin(), epos = node->children.end(); it != epos; ++it)
+  {
+    clearNode(it->second);
+    delete it->second;
+  }
+  node->children.clear();
+  node->items.clear();
+}
+
+void NameTrie::insert(const dtpString &name, uint index)
+{
+  Node *node = &m_root;
+  dtpString::size_type start = 0, pos;
+  dtpString segment;
+
+  do {
+    pos = name.find(NAME_TRIE_SEPARATOR, start);
+    segment = name.substr(start, (pos == dtpString::npos) ? dtpString::npos : pos - start);
+
+    NodeMap::iterator it = node->children.find(segment);
+    if (it == node->children.end())
+    {
+      it = node->children.insert(NodeMap::value_type(segment, new Node())).first;
+      m_memory += nodeCost(segment);
+    }
+    node = it->second;
+    start = pos + 1;
+  } while(pos != dtpString::npos);
+
+  node->items.push_back(index);
+  m_memory += sizeof(uint);
+}
+
+void NameTrie::remove(const dtpString &name, uint index)
+{
+  removeFrom(&m_root, name, 0, index);
+}
+
+bool NameTrie::removeFrom(Node *node, const dtpString &name, dtpString::size_type start, uint index)
+{
+  dtpString::size_type pos = name.find(NAME_TRIE_SEPARATOR, start);
+  NodeMap::iterator it = node->children.find(name.substr(start, (pos == dtpString::npos) ? dtpString::npos : pos - start));
+  if (it == node->children.end())
+    return false;
+
+  Node *child = it->second;
+  bool emptyChild;
+  if (pos == dtpString::npos)
+  {
+    std::vector<uint>::iterator itemIt = std::find(child->items.begin(), child->items.end(), index);
+    if (itemIt != child->items.end())
+    {
+      child->items.erase(itemIt);
+      m_memory -= sizeof(uint);
+    }
+    emptyChild = child->items.empty() && child->children.empty();
+  } else {
+    emptyChild = removeFrom(child, name, pos + 1, index);
+  }
+
+  if (emptyChild)
+  {
+    m_memory -= nodeCost(it->first);
+    delete child;
+    node->children.erase(it);
+  }
+  return node->items.empty() && node->children.empty();
+}
+
+void NameTrie::findByPrefix(const dtpString &prefix, std::vector<uint> &output) const
+{
+  const Node *node = &m_root;
+  dtpString::size_type start = 0, pos;
+
+  // complete segments
+  while((pos = prefix.find(NAME_TRIE_SEPARATOR, start)) != dtpString::npos)
+  {
+    NodeMap::const_iterator it = node->children.find(prefix.substr(start, pos - start));
+    if (it == node->children.end())
+      return;
+    node = it->second;
+    start = pos + 1;
+  }
+
+  // last, partial segment - children are sorted, so matching ones are adjacent
+  dtpString last = prefix.substr(start);
+  for(NodeMap::const_iterator it = node->children.lower_bound(last), epos = node->children.end(); 
+      (it != epos) && (it->first.compare(0, last.size(), last) == 0); ++it)
+    collect(it->second, output);
+}
+
+void NameTrie::collect(const Node *node, std::vector<uint> &output)
+{
+  output.insert(output.end(), node->items.begin(), node->items.end());
+  for(NodeMap::const_iterator it = node->children.begin(), epos = node->children.end(); it != epos; ++it)
+    collect(it->second, output);
+}
@@ -17,15 +17,39 @@
 ///
 ///
 
+/// When defined, each thread increments counters in it's own shard, without locks
+#define PERF_COUNTER_USE_SHARDS
+
+/// When defined, increments mark counters as changed for Counter::visitChanged 
+/// (a full fence per increment), otherwise visitChanged visits all counters
+#define PERF_COUNTER_TRACK_CHANGES
+
 // ----------------------------------------------------------------------------
 // Headers
 // ----------------------------------------------------------------------------
-#include "boost/ptr_container/ptr_map.hpp"
+#include <vector>
+#include <map>
+#include <unordered_map>
+
 //#include "sc/utils.h"
 
 #include "dtp/dnode.h"
 
 #include "perf/details/ptypes.h"
+#include "perf/details/platform.h"
+#include "perf/details/atomic_ops.h"
+#include "perf/details/NameHash.h"
+#include "perf/details/NameRegistry.h"
+#include "perf/details/FlatNameMap.h"
+#include "perf/details/NameTrie.h"
+#include "perf/details/RejectedNameCache.h"
+#include "perf/details/DirtyTracker.h"
+#include "perf/Histogram.h"
+#include "perf/CompiledFilter.h"
+
+#ifdef PERF_COUNTER_USE_SHARDS
+#include "perf/details/CounterShards.h"
+#endif
 
 namespace perf {
 
@@ -36,10 +60,42 @@ namespace perf {
 // ----------------------------------------------------------------------------
 // Forward class definitions
 // ----------------------------------------------------------------------------
+class CounterItem;
+
+namespace Details {
+  /// Counter resolved on first use, stored in static variable
+  struct StaticCounterRef {
+    CounterItem * volatile item;
+    const char *name;
+  };
+
+#ifdef PERF_HAS_CONSTEXPR
+  /// Single static counter reference for each distinct name hash
+  template<uint64 NameHash>
+  struct StaticCounterSlot {
+    static StaticCounterRef ref;
+  };
+
+  template<uint64 NameHash>
+  StaticCounterRef StaticCounterSlot<NameHash>::ref = { DTP_NULL, DTP_NULL };
+#endif
+};
 
 // ----------------------------------------------------------------------------
 // Constants
 // ----------------------------------------------------------------------------
+/// Counter receiving increments of names rejected by registry limits (see Counter::setCapacity)
+const char * const COUNTER_OVERFLOW_NAME = "perf.overflow";
+/// Counter of rejected registrations
+const char * const COUNTER_REJECTED_NAME = "perf.overflow.rejected";
+/// Max number of labels of labelled counter
+const uint COUNTER_MAX_LABELS = 8;
+/// Max number of series of labelled counters (all families)
+const uint COUNTER_MAX_SERIES = (1U << 20);
+/// Generation stored in CounterSnapshot for indexes of removed counters
+const uint COUNTER_REMOVED_GENERATION = 0xffffffffU;
+/// Max sample rate of sampled counter (see Counter::setSampleRate)
+const uint COUNTER_MAX_SAMPLE_RATE = (1U << 20);
 
 // ----------------------------------------------------------------------------
 // Class definitions
@@ -47,26 +103,354 @@ namespace perf {
 // ----------------------------------------------------------------------------
 // Counter
 // ----------------------------------------------------------------------------
+namespace Details {
+  /// Per-thread linear congruential generator used by sampled increments.
+  /// Low bits of LCG are weak, next() returns upper bits of 64-bit state.
+  class SampleRandom {
+  public:
+    static uint next()
+    {
+      uint64 x = m_state;
+      if (PERF_UNLIKELY(x == 0))
+        x = seed();
+      x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+      m_state = x;
+      return static_cast<uint>(x >> 40);
+    }
+  protected:
+    static uint64 seed();
+  private:
+    static PERF_THREAD_LOCAL uint64 m_state;
+    // number of seeded threads
+    static volatile uint64 m_seedCount;
+  };
+};
+
 class CounterItem {
 public:
-  CounterItem() { m_total = 0; }
+  CounterItem() { m_total = 0; m_slot = 0; m_sampleMask = 0; m_pinned = false; }
   ~CounterItem() {}
   void inc();
   void inc(uint64 value);
   void reset();
+  /// Adds value saved by previous run (see CounterStore)
+  void restore(uint64 value);
   uint64 getTotal() const;
+  /// Calculates total using a sum of all shards for item's slot
+  uint64 calcTotal(uint64 shardTotal) const;
+  void setSlot(uint value) { m_slot = value; }
+  uint getSlot() const { return m_slot; }
+  /// Marks item referenced by handle, such item is never removed
+  void pin() { m_pinned = true; }
+  bool isPinned() const { return m_pinned; }
+  /// Sets sample rate (power of two), 1 = each increment is recorded
+  void setSampleRate(uint rate) { Details::atomic_store(&m_sampleMask, rate - 1); }
+  uint getSampleRate() const { return Details::atomic_load(&m_sampleMask) + 1; }
+  uint getSampleMask() const { return Details::atomic_load(&m_sampleMask); }
 private:
+  // in sharded mode: sum of shards at the time of last reset
   uint64 m_total;
+  // index of item's value in counter shards
+  uint m_slot;
+  // sample rate - 1
+  volatile uint m_sampleMask;
+  bool m_pinned;
+};
+
+/// Value which can be set, increased and decreased (queue depth, pool occupancy)
+class GaugeItem {
+public:
+  GaugeItem() { m_value = 0; }
+  ~GaugeItem() {}
+  void set(int64 value) { Details::atomic_store(&m_value, value); }
+  void add(int64 value) { Details::atomic_fetch_add(&m_value, value); }
+  void sub(int64 value) { Details::atomic_fetch_add(&m_value, -value); }
+  void reset() { set(0); }
+  int64 getValue() const { return Details::atomic_load(&m_value); }
+private:
+  volatile int64 m_value;
+};
+
+/// Statistics of values recorded in AggregateItem
+struct AggregateStats {
+  uint64 count;
+  uint64 sum;
+  uint64 min;
+  uint64 max;
+  double getMean() const { return (count > 0) ? (static_cast<double>(sum) / static_cast<double>(count)) : 0.0; }
+};
+
+/// Tracks count, sum, min & max of recorded values (payload sizes, batch sizes) without locks
+class AggregateItem {
+public:
+  AggregateItem() { reset(); }
+  ~AggregateItem() {}
+  void record(uint64 value);
+  void reset();
+  /// Returns current statistics, fields are read one by one so they can 
+  /// be slightly out of sync if values are recorded at the same time
+  void getStats(AggregateStats &output) const;
+private:
+  volatile uint64 m_count;
+  volatile uint64 m_sum;
+  volatile uint64 m_min;
+  volatile uint64 m_max;
+};
+
+/// Number of time buckets in rate item
+const uint RATE_BUCKET_COUNT = 64;
+/// Max number of reported windows per rate item
+const uint RATE_MAX_WINDOWS = 4;
+const uint RATE_DEF_BUCKET_MS = 1000;
+
+/// Measures throughput (events per second) over sliding time windows.
+/// Keeps running total and a ring of time buckets, each bucket remembers
+/// total at the moment of first event in it, so sum over a window is a 
+/// difference of current total and start of the oldest bucket in window.
+/// Buckets are rotated lazily on increment, increment does not allocate
+/// and never waits for other threads: event added while other thread 
+/// rotates it's bucket can be counted in the previous bucket.
+class RateItem {
+public:
+  RateItem();
+  ~RateItem() {}
+  /// Sets bucket resolution & reported windows, resets values. 
+  /// Not synchronized with inc() & readers - call before item is published.
+  /// Windows longer than (RATE_BUCKET_COUNT - 1) buckets are shortened.
+  void configure(uint bucketMs, const uint *windowsMs, uint windowCount);
+  void inc(uint64 value, uint64 nowMs);
+  void reset();
+  /// Returns sum of values added in a given window ending at <nowMs>
+  uint64 getSum(uint windowMs, uint64 nowMs) const;
+  /// Returns events per second in a given window ending at <nowMs>
+  double getRate(uint windowMs, uint64 nowMs) const;
+  uint64 getTotal() const { return Details::atomic_load(&m_total); }
+  uint getWindowCount() const { return m_windowCount; }
+  uint getWindow(uint index) const { return m_windows[index]; }
+protected:
+  uint64 getFirstEpoch(uint windowMs, uint64 nowMs) const;
+private:
+  struct Bucket {
+    // bucket number (time / bucket size) + 1, zero if bucket was not used
+    volatile uint64 epoch;
+    // total at the time of first event in bucket
+    volatile uint64 start;
+  };
+  Bucket m_buckets[RATE_BUCKET_COUNT];
+  volatile uint64 m_total;
+  uint m_bucketMs;
+  uint m_windows[RATE_MAX_WINDOWS];
+  uint m_windowCount;
+};
+
+/// Default number of keys tracked by TopKItem
+const uint TOPK_DEF_CAPACITY = 1000;
+/// Default number of keys reported by visitors
+const uint TOPK_DEF_REPORT_SIZE = 10;
+
+/// Key tracked by TopKItem, true count is in range [count - error, count]
+struct TopKEntry {
+  dtpString key;
+  uint64 count;
+  uint64 error;
+};
+
+typedef std::vector<TopKEntry> TopKEntryColn;
+
+/// Heavy hitters of an unbounded set of keys (space-saving algorithm).
+/// Keeps at most <capacity> keys: unknown key replaces the one with the lowest count 
+/// and inherits it's count as error. Any key with count above total / capacity 
+/// is guaranteed to be tracked. Memory is bounded by capacity.
+/// Not thread-safe, Counter guards it with a lock.
+class TopKItem {
+public:
+  TopKItem();
+  ~TopKItem() {}
+  /// Sets max number of tracked keys & number of keys reported by visitors, resets values
+  void configure(uint capacity, uint reportSize);
+  void inc(const dtpString &key, uint64 value);
+  void reset();
+  /// Returns up to <k> tracked keys with the highest counts, sorted by count (descending)
+  void getTop(uint k, TopKEntryColn &output) const;
+  /// Returns sum of all increments
+  uint64 getTotal() const { return m_total; }
+  uint getCapacity() const { return m_capacity; }
+  uint getReportSize() const { return m_reportSize; }
+protected:
+  void siftDown(uint pos);
+  void swapEntries(uint a, uint b);
+private:
+  typedef std::unordered_map<dtpString, uint> PositionMap;
+  // min-heap by count
+  TopKEntryColn m_heap;
+  // position of key in heap
+  PositionMap m_positions;
+  uint64 m_total;
+  uint m_capacity;
+  uint m_reportSize;
+};
+
+typedef Details::NameRegistry<CounterItem> CounterItemMapColn;
+typedef Details::NameRegistry<GaugeItem> GaugeItemMapColn;
+typedef Details::NameRegistry<RateItem> RateItemMapColn;
+typedef Details::NameRegistry<AggregateItem> AggregateItemMapColn;
+typedef Details::NameRegistry<Histogram> HistogramItemMapColn;
+typedef Details::NameRegistry<TopKItem> TopKItemMapColn;
+typedef std::vector<uint64> CounterTotalColn;
+
+/// Labelled counter definition: ids of label keys, in order of declaration
+struct CounterFamilyItem {
+  uint id;
+  std::vector<uint> keys;
 };
 
-typedef boost::ptr_map<dtpString,CounterItem> CounterItemMapColn;
+typedef Details::NameRegistry<CounterFamilyItem> CounterFamilyMapColn;
+/// Interned label keys & values, id = index
+typedef Details::NameRegistry<uint> CounterSymbolMapColn;
+/// Series of labelled counters, key = packed family & label value ids
+typedef Details::NameRegistry<CounterItem> CounterSeriesMapColn;
+/// Totals indexed by label value id
+typedef std::map<uint, uint64> CounterLabelTotalColn;
+
+/// Pre-resolved counter, see Counter::registerName
+class CounterHandle {
+public:
+  CounterHandle() { m_item = DTP_NULL; }
+  bool isNull() const { return (m_item == DTP_NULL); }
+protected:
+  explicit CounterHandle(CounterItem *item) { m_item = item; }
+private:
+  friend class Counter;
+  friend class CounterBatch;
+  CounterItem *m_item;
+};
 
-/// Counter visitor
+/// Set of counters updated together, see Counter::incBatch.
+/// Counters with consecutive slots (e.g. registered by Counter::registerBatch, 
+/// when no slots of removed counters were free) 
+/// are grouped into runs, each run is updated with a single vector add.
+class CounterBatch {
+public:
+  CounterBatch() {}
+  /// Prepares batch for a given list of handles, values passed to incBatch follow the same order
+  void assign(const CounterHandle *handles, uint count);
+  uint size() const { return m_items.size(); }
+  /// Returns number of runs of consecutive slots
+  uint getRunCount() const { return m_runs.size(); }
+private:
+  friend class Counter;
+  struct Run {
+    // slot of first counter in run
+    uint slot;
+    // index of first counter in batch
+    uint offset;
+    uint count;
+  };
+  std::vector<CounterItem *> m_items;
+  std::vector<Run> m_runs;
+};
+
+/// Labelled counter, see Counter::registerFamily
+class CounterFamily {
+public:
+  CounterFamily() { m_id = 0; m_labelCount = 0; m_valid = false; }
+  bool isNull() const { return !m_valid; }
+  uint getId() const { return m_id; }
+  uint getLabelCount() const { return m_labelCount; }
+protected:
+  CounterFamily(uint id, uint labelCount) { m_id = id; m_labelCount = labelCount; m_valid = true; }
+private:
+  friend class Counter;
+  uint m_id;
+  uint m_labelCount;
+  bool m_valid;
+};
+
+/// Label of series passed to visitor
+struct CounterLabel {
+  const dtpString *key;
+  const dtpString *value;
+};
+
+/// Values of all labelled counter series, label values are kept as interned ids
+/// (see Counter::getSymbol), so series can be grouped without string operations.
+class CounterLabelSnapshot {
+public:
+  struct Series {
+    uint family;
+    uint labelCount;
+    uint labels[COUNTER_MAX_LABELS];
+    uint64 value;
+  };
+
+  CounterLabelSnapshot() {}
+  ~CounterLabelSnapshot() {}
+  uint size() const { return m_series.size(); }
+  const Series &at(uint index) const { return m_series[index]; }
+  /// Sums values of family's series grouped by value of label <labelIndex>, 
+  /// output is indexed by label value id
+  void sumByLabel(CounterFamily family, uint labelIndex, CounterLabelTotalColn &output) const;
+  /// Returns sum of all series of family
+  uint64 getFamilyTotal(CounterFamily family) const;
+private:
+  friend class Counter;
+  std::vector<Series> m_series;
+};
+
+/// Values of all counters taken in one pass, indexed by counter slot
+/// (order of registration). Buffer is reused by subsequent Counter::takeSnapshot calls.
+class CounterSnapshot {
+public:
+  CounterSnapshot() { m_timeMs = 0; }
+  ~CounterSnapshot() {}
+  uint size() const { return m_values.size(); }
+  bool empty() const { return m_values.empty(); }
+  uint64 getValue(uint index) const { return m_values[index]; }
+  /// Returns contiguous array of size() values
+  const uint64 *getValues() const { return m_values.empty() ? DTP_NULL : &m_values[0]; }
+  /// Returns name of counter with a given index, empty if counter was removed
+  dtpString getName(uint index) const;
+  /// Returns generation of index (see NameRegistry), changes when index is reused
+  uint getGeneration(uint index) const { return m_generations[index]; }
+  /// \return <true> if there was no counter with a given index when snapshot was taken
+  bool isRemoved(uint index) const { return (m_generations[index] == COUNTER_REMOVED_GENERATION); }
+  /// Returns time of snapshot (os_uptime_ms)
+  uint64 getTimeMs() const { return m_timeMs; }
+  void clear() { m_values.clear(); m_generations.clear(); m_timeMs = 0; }
+  /// Calculates increments between <prev> and <cur> into output.
+  /// Counters created (or indexes reused) after <prev> was taken are counted from zero,
+  /// counters reset in between report their current value.
+  static void delta(const CounterSnapshot &prev, const CounterSnapshot &cur, CounterSnapshot &output);
+private:
+  friend class Counter;
+  CounterTotalColn m_values;
+  std::vector<uint> m_generations;
+  uint64 m_timeMs;
+};
+
+/// Counter visitor.
+/// Default implementations of visitAggregate, visitRate, visitHistogram & visitTopK report 
+/// values under suffixed names (.count, .sum, .p99, ...) - these suffixes are reserved, 
+/// counters using them would be reported twice under the same name.
 class CounterVisitorIntf {
 public:
   CounterVisitorIntf() {}
   virtual ~CounterVisitorIntf() {}
   virtual void visit(const dtpString &timerName, uint64 value) = 0;
+  /// By default reports gauge as a counter, negative values are reported as 0
+  virtual void visitGauge(const dtpString &name, int64 value);
+  /// By default reports aggregate as counters <name>.count, .sum, .min, .max, .mean
+  virtual void visitAggregate(const dtpString &name, const AggregateStats &stats);
+  /// Called for each window of rate item. 
+  /// By default reports rate as counter <name>.rate<window>s (or ms), rounded.
+  virtual void visitRate(const dtpString &name, uint windowMs, double eventsPerSec);
+  /// By default reports histogram as counters <name>.count, .min, .p50, .p90, .p99, .p999, .max
+  virtual void visitHistogram(const dtpString &name, const HistogramStats &stats);
+  /// By default reports series of labelled counter as counter <family>{key=value,...}
+  virtual void visitSeries(const dtpString &family, const CounterLabel *labels, uint labelCount, uint64 value);
+  /// Called with top keys of TopKItem (sorted by count).
+  /// By default reports them as counters <name>.top.<key>
+  virtual void visitTopK(const dtpString &name, const TopKEntryColn &entries);
 };
 
 /// Global counter storage
@@ -76,16 +460,187 @@ public:
   static void inc(const dtpString &a_name, uint64 value);
   static void reset(const dtpString &a_name);
   static uint64 getTotal(const dtpString &a_name);
+  /// Resolves counter name once, returned handle can be used instead of name
+  static CounterHandle registerName(const dtpString &a_name);
+  /// Returns handle stored in static reference, resolves it on first use
+  static CounterHandle resolve(Details::StaticCounterRef &ref, const char *a_name);
+  static void inc(CounterHandle handle);
+  static void inc(CounterHandle handle, uint64 value);
+  /// Adds values[i] to counter handles[i] for i in [0, count), 
+  /// using a single shard lookup (or lock) for the whole batch
+  static void incBatch(const CounterHandle *handles, const uint64 *values, uint count);
+  /// Adds values[i] to i-th counter of batch, values must have batch.size() elements
+  static void incBatch(const CounterBatch &batch, const uint64 *values);
+  /// Resolves list of names once, new counters get consecutive slots, 
+  /// so batch can be updated with vector adds.
+  /// Slots of removed counters are reused first (last removed first), 
+  /// so after removals batch can be split into more runs (see CounterBatch::getRunCount).
+  static CounterBatch registerBatch(const dtpString *names, uint count);
+  /// Records increment with probability 1 / sample rate of item, 
+  /// recorded increment adds sample rate, so total is an estimate of real count
+  static void incSampled(CounterHandle handle);
+  /// Sets sample rate of counter, rounded down to power of two (max COUNTER_MAX_SAMPLE_RATE).
+  /// Rate 1 (default) records each increment.
+  /// \return <false> if counter could not be registered (name above limit, see setCapacity), rate is not changed
+  static bool setSampleRate(const dtpString &a_name, uint rate);
+  static uint getSampleRate(const dtpString &a_name);
+  /// Returns error bound of sampled counter total (3 standard deviations, ~99.7% confidence), 
+  /// assuming all increments of counter are sampled
+  static uint64 getErrorBound(CounterHandle handle);
+  static void reset(CounterHandle handle);
+  static uint64 getTotal(CounterHandle handle);
+  /// Adds total saved by previous run of process to counter.
+  /// Limited like inc(): above capacity (see setCapacity) value is added to COUNTER_OVERFLOW_NAME item.
+  static void restore(const dtpString &a_name, uint64 value);
+  /// Removes counter item, memory is released when no thread can use it.
+  /// Items referenced by handles (registerName, PERF_COUNT) are not removed.
+  /// \return <true> if item has been removed
+  static bool remove(const dtpString &a_name);
+  /// Removes counter items matching any of patterns, returns number of removed items
+  static uint removeByFilter(const scDataNode &filterList);
+  static uint removeByFilter(CompiledFilter &filter);
+  /// Limits number of items and approximate memory of registry of each item type 
+  /// (counters, gauges, aggregates, rates, histograms, top-K) and of counter name index 
+  /// (zero = no limit).
+  /// Names registered above the limit are folded into COUNTER_OVERFLOW_NAME item of the same type.
+  /// Rejected names are cached (up to REJECTED_NAME_CACHE_SIZE per type, outside of the limit),
+  /// so their next uses do not take the registry lock and each one increments 
+  /// COUNTER_REJECTED_NAME once. When cache is full, other new names go to overflow item and
+  /// are counted on each use, without the lock. Cache is cleared when limits change and 
+  /// after removals of counters freed enough capacity.
+  static void setCapacity(uint maxItems, size_t maxMemory);
+  /// Returns number of rejected names
+  static uint64 getRejectedCount();
+  // gauges
+  static void setGauge(const dtpString &a_name, int64 value);
+  static void addGauge(const dtpString &a_name, int64 value);
+  static void subGauge(const dtpString &a_name, int64 value);
+  static int64 getGauge(const dtpString &a_name);
+  // aggregates
+  static void record(const dtpString &a_name, uint64 value);
+  static void resetStats(const dtpString &a_name);
+  static void getStats(const dtpString &a_name, AggregateStats &output);
+  // rates
+  static void incRate(const dtpString &a_name, uint64 value = 1);
+  /// \return events per second in a given window (up to last 63 buckets)
+  static double getRate(const dtpString &a_name, uint windowMs);
+  /// Creates rate item with given time resolution and reported windows.
+  /// Default: 1s buckets, windows: 1s, 10s, 60s.
+  /// \return <false> if item already exists (configure it before first use), it is not changed then
+  static bool configureRate(const dtpString &a_name, uint bucketMs, const uint *windowsMs, uint windowCount);
+  // histograms
+  static void recordHistogram(const dtpString &a_name, uint64 value);
+  /// Adds all values from <src> to histogram <a_name>
+  static void mergeHistogram(const dtpString &a_name, const Histogram &src);
+  static void resetHistogram(const dtpString &a_name);
+  static void getHistogram(const dtpString &a_name, HistogramStats &output);
+  /// \return value below or equal to which <percent> of recorded values fall
+  static uint64 getPercentile(const dtpString &a_name, double percent);
+  // heavy hitters
+  static void incTopK(const dtpString &a_name, const dtpString &key, uint64 value = 1);
+  static void getTopK(const dtpString &a_name, uint k, TopKEntryColn &output);
+  static void resetTopK(const dtpString &a_name);
+  /// Sets max number of tracked keys and number of keys reported by visitAll, resets item.
+  /// Default: 1000 tracked keys, top 10 reported.
+  static void configureTopK(const dtpString &a_name, uint capacity, uint reportSize);
+  // labelled counters
+  /// Declares labelled counter with a given list of label keys.
+  /// Throws std::invalid_argument if there are more than COUNTER_MAX_LABELS keys
+  /// or family was already registered with different keys.
+  static CounterFamily registerFamily(const dtpString &a_name, const dtpString *labelKeys, uint labelCount);
+  /// Resolves series once, returned handle can be used with inc(CounterHandle).
+  /// Throws std::invalid_argument if labelCount differs from the family's.
+  static CounterHandle registerSeries(CounterFamily family, const dtpString *labelValues, uint labelCount);
+  /// Increments series identified by label values (in order of family keys)
+  static void inc(CounterFamily family, const dtpString *labelValues, uint labelCount, uint64 value = 1);
+  static uint64 getTotal(CounterFamily family, const dtpString *labelValues, uint labelCount);
+  /// Copies values of all series into snapshot
+  static void takeLabelSnapshot(CounterLabelSnapshot &output);
+  /// Returns interned label key or value with a given id
+  static const dtpString &getSymbol(uint id);
+  /// Returns id of interned label key or value, adds it if needed
+  static uint internSymbol(const dtpString &a_name);
+  static const dtpString &getFamilyName(CounterFamily family);
+  // reporting - all item types
+  /// Copies values of all counter items into snapshot
+  static void takeSnapshot(CounterSnapshot &output);
+  /// Returns name of counter with a given index (slot) and generation, see CounterSnapshot.
+  /// Returns empty string if index is not used by that generation anymore.
+  static dtpString getCounterName(uint index, uint generation);
+  /// Visits counter items with names starting with <prefix>
+  static void visitByPrefix(const dtpString &prefix, CounterVisitorIntf *visitor);
+  /// Returns sum of counter items with names starting with <prefix> (e.g. "db.pool.")
+  static uint64 getTotalByPrefix(const dtpString &prefix);
   static void visitAll(CounterVisitorIntf *visitor);
+  /// Visits counter items changed after generation <since> (returned by previous call).
+  /// All counter items are visited if since = 0 or changes are no longer known.
+  /// Other item types (gauges, histograms, series...) are not visited.
+  /// \return current generation
+  static uint64 visitChanged(uint64 since, CounterVisitorIntf *visitor);
   static void getAll(scDataNode &output);
   static void getByFilter(const scDataNode &filterList, scDataNode &output);
+  /// Reports items matching filter, keep filter between calls to reuse it's cache
+  static void getByFilter(CompiledFilter &filter, scDataNode &output);
 protected:
   static CounterItem *addItem(const dtpString &a_name);
   static CounterItem *getItem(const dtpString &a_name);
   static CounterItem *checkItem(const dtpString &a_name);
+  /// Finds or adds item and marks it as referenced by handle
+  static CounterItem *pinItem(const dtpString &a_name);
+  /// Deletes removed registry entry (EpochDeleter)
+  static void releaseItem(void *entry);
   static scDataNode removeNonMatching(const scDataNode &input, const scDataNode &filterList);
+  static void prepareTotals(CounterTotalColn &output);
+  /// Prepares totals of selected slots, output[i] is a total for slots[i] (see CounterItem::calcTotal)
+  static void prepareTotals(const std::vector<uint> &slots, CounterTotalColn &output);
+  static uint64 getItemTotal(const CounterItem &item, const CounterTotalColn &totals);
+  static CounterItem *resolveItem(Details::StaticCounterRef &ref, const char *a_name);
+  /// Visits items matching filter, all items if filter is NULL
+  static void visitMatching(CounterVisitorIntf *visitor, CompiledFilter *filter);
+  /// Finds indexes (slots) of counter items with a given name prefix
+  static void findByPrefix(const dtpString &prefix, std::vector<uint> &output);
+  static GaugeItem *checkGauge(const dtpString &a_name);
+  static AggregateItem *checkAggregate(const dtpString &a_name);
+  static RateItem *checkRate(const dtpString &a_name);
+  static Histogram *checkHistogram(const dtpString &a_name);
+  static TopKItem *checkTopK(const dtpString &a_name);
+  /// Finds item of other type than counter, adds it if not found. 
+  /// Names above limits of registry go to it's overflow item.
+  template<typename T>
+  static T *checkNamedItem(Details::NameRegistry<T> &registry, Details::RejectedNameCache &rejectedNames,
+    const dtpString &a_name);
+  /// Returns overflow item of registry for rejected name, counts name if it is not cached yet
+  template<typename T>
+  static T *rejectName(Details::NameRegistry<T> &registry, Details::RejectedNameCache &rejectedNames,
+    const dtpString &a_name, uint64 hash);
+  /// Registers overflow item in registry and sets it's limits
+  template<typename T>
+  static void setNamedCapacity(Details::NameRegistry<T> &registry, Details::RejectedNameCache &rejectedNames,
+    uint maxItems, size_t maxMemory);
+  static CounterItem *checkSeries(uint familyId, const dtpString *labelValues, uint labelCount);
+  static void visitSeries(CounterVisitorIntf *visitor, CompiledFilter *filter);
 private:
   static CounterItemMapColn m_items;
+  static GaugeItemMapColn m_gauges;
+  static AggregateItemMapColn m_aggregates;
+  static RateItemMapColn m_rates;
+  static HistogramItemMapColn m_histograms;
+  static TopKItemMapColn m_topK;
+  // prefix index of counter item names
+  static Details::NameTrie m_names;
+  // names folded into overflow items, one cache per registry
+  static Details::RejectedNameCache m_rejectedNames;
+  static Details::RejectedNameCache m_rejectedGauges;
+  static Details::RejectedNameCache m_rejectedAggregates;
+  static Details::RejectedNameCache m_rejectedRates;
+  static Details::RejectedNameCache m_rejectedHistograms;
+  static Details::RejectedNameCache m_rejectedTopK;
+  // slots of changed counter items
+  static Details::DirtyTracker m_changes;
+  // labelled counters
+  static CounterSymbolMapColn m_symbols;
+  static CounterFamilyMapColn m_families;
+  static CounterSeriesMapColn m_series;
 };
 
 /// Counter storage that can be used as private counter collection
@@ -100,9 +655,113 @@ public:
   void clear();
   void getAll(scDataNode &output);
 protected:
-  scDataNode m_values;
+  Details::FlatNameMap<uint64> m_values;
 };
 
+// ----------------------------------------------------------------------------
+// Inline functions
+// ----------------------------------------------------------------------------
+#ifdef PERF_COUNTER_USE_SHARDS
+inline void CounterItem::inc()
+{
+  Details::CounterShards::add(m_slot, 1);
+}
+
+inline void CounterItem::inc(uint64 value)
+{
+  assert(value <= 1000000000);
+  Details::CounterShards::add(m_slot, value);
+}
+#endif
+
+inline void Counter::inc(CounterHandle handle)
+{
+  assert(!handle.isNull());
+#ifdef PERF_COUNTER_USE_SHARDS
+  handle.m_item->inc();
+#else
+#pragma omp critical(counter)
+{
+  handle.m_item->inc(1);
+}
+#endif
+  // marked after update, so reader which has seen the mark also sees the value
+#ifdef PERF_COUNTER_TRACK_CHANGES
+  m_changes.mark(handle.m_item->getSlot());
+#endif
+}
+
+inline void Counter::inc(CounterHandle handle, uint64 value)
+{
+  assert(!handle.isNull());
+#ifdef PERF_COUNTER_USE_SHARDS
+  handle.m_item->inc(value);
+#else
+#pragma omp critical(counter)
+{
+  handle.m_item->inc(value);
+}
+#endif
+#ifdef PERF_COUNTER_TRACK_CHANGES
+  m_changes.mark(handle.m_item->getSlot());
+#endif
+}
+
+inline void Counter::incSampled(CounterHandle handle)
+{
+  assert(!handle.isNull());
+  uint mask = handle.m_item->getSampleMask();
+  if ((mask != 0) && PERF_LIKELY((Details::SampleRandom::next() & mask) != 0))
+    return;
+  inc(handle, static_cast<uint64>(mask) + 1);
+}
+
+inline CounterHandle Counter::resolve(Details::StaticCounterRef &ref, const char *a_name)
+{
+  CounterItem *item = Details::atomic_load_acquire(&ref.item);
+  if (PERF_UNLIKELY(item == DTP_NULL))
+    item = resolveItem(ref, a_name);
+  // different names with the same hash would share a counter
+  assert((ref.name == a_name) || (strcmp(ref.name, a_name) == 0));
+  return CounterHandle(item);
+}
+
 }; // namespace perf
 
+// ----------------------------------------------------------------------------
+// Macros
+// ----------------------------------------------------------------------------
+/// Increments counter with a name given as string literal.
+/// Name is resolved only once, then it's counter is used directly.
+/// Usage: PERF_COUNT("parser.tokens");
+#define PERF_COUNT(a_name) PERF_COUNT_ADD(a_name, 1)
+
+#ifdef PERF_HAS_CONSTEXPR
+#define PERF_COUNTER_STATIC_REF(a_name) \
+  perf::Details::StaticCounterSlot<perf::Details::name_hash(a_name)>::ref
+
+/// Adds value to counter with a name given as string literal
+#define PERF_COUNT_ADD(a_name, a_value) \
+  perf::Counter::inc(perf::Counter::resolve(PERF_COUNTER_STATIC_REF(a_name), a_name), (a_value))
+
+/// Sampled increment of counter with a name given as string literal,
+/// sample rate is set with Counter::setSampleRate.
+/// Usage: PERF_COUNT_SAMPLED("net.packets");
+#define PERF_COUNT_SAMPLED(a_name) \
+  perf::Counter::incSampled(perf::Counter::resolve(PERF_COUNTER_STATIC_REF(a_name), a_name))
+#else
+// no compile-time hashing - one static reference per call site
+#define PERF_COUNT_ADD(a_name, a_value) \
+  do { \
+    static perf::Details::StaticCounterRef perfCounterRef = { DTP_NULL, DTP_NULL }; \
+    perf::Counter::inc(perf::Counter::resolve(perfCounterRef, a_name), (a_value)); \
+  } while(0)
+
+#define PERF_COUNT_SAMPLED(a_name) \
+  do { \
+    static perf::Details::StaticCounterRef perfCounterRef = { DTP_NULL, DTP_NULL }; \
+    perf::Counter::incSampled(perf::Counter::resolve(perfCounterRef, a_name)); \
+  } while(0)
+#endif
+
 #endif // _PERFCOUNTER_H__
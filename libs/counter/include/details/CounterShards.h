@@ -0,0 +1,125 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CounterShards.h
+// Project:     perfLib
+// Purpose:     Per-thread storage of counter values
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFCOUNTERSHARDS_H__
+#define _PERFCOUNTERSHARDS_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file CounterShards.h
+///
+/// Each thread increments counters in it's own shard, without locks.
+/// Shard is a set of cache-aligned chunks of values indexed by counter slot.
+/// Totals are calculated on read as a sum of all shards.
+/// When thread exits, it's shard is merged into "retired" shard, so
+/// totals are never lost.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include "perf/details/ptypes.h"
+#include "perf/details/platform.h"
+#include "perf/details/atomic_ops.h"
+#include "perf/details/vector_ops.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const uint COUNTER_SHARD_CHUNK_BITS = 10;
+const uint COUNTER_SHARD_CHUNK_SIZE = (1U << COUNTER_SHARD_CHUNK_BITS);
+const uint COUNTER_SHARD_CHUNK_MASK = COUNTER_SHARD_CHUNK_SIZE - 1;
+const uint COUNTER_SHARD_MAX_CHUNKS = 4096;
+/// Max number of slots (counters) supported by shards
+const uint COUNTER_SHARD_MAX_SLOTS = COUNTER_SHARD_MAX_CHUNKS * COUNTER_SHARD_CHUNK_SIZE;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+/// Block of counter values, always cache-aligned so no two threads share a line
+struct CounterShardChunk {
+  volatile uint64 values[COUNTER_SHARD_CHUNK_SIZE];
+};
+
+/// Counter values of a single thread
+class CounterShard {
+public:
+  CounterShard();
+  ~CounterShard();
+  /// Adds value to slot, can be called by owner thread only
+  void add(uint slot, uint64 value)
+  {
+    atomic_add_single_writer(slotPtr(slot), value);
+  }
+  /// Adds values[i] to slot + i for i in [0, count), can be called by owner thread only
+  void addRange(uint slot, const uint64 *values, uint count);
+  /// Returns value of slot, can be called by any thread
+  uint64 get(uint slot) const;
+  /// Adds values of slots [0, slotCount) to output
+  void sumInto(uint slotCount, uint64 *output) const;
+  /// Adds all values from a given shard to this one
+  void merge(const CounterShard &src);
+  /// Sets value of slot to zero, owner thread must not update slot at the same time
+  void clear(uint slot);
+protected:
+  volatile uint64 *slotPtr(uint slot)
+  {
+    assert(slot < COUNTER_SHARD_MAX_SLOTS);
+    CounterShardChunk *chunk = atomic_load(&m_chunks[slot >> COUNTER_SHARD_CHUNK_BITS]);
+    if (PERF_UNLIKELY(chunk == DTP_NULL))
+      chunk = allocChunk(slot >> COUNTER_SHARD_CHUNK_BITS);
+    return &(chunk->values[slot & COUNTER_SHARD_CHUNK_MASK]);
+  }
+  CounterShardChunk *allocChunk(uint chunkIdx);
+private:
+  friend class CounterShards;
+  CounterShardChunk * volatile m_chunks[COUNTER_SHARD_MAX_CHUNKS];
+  CounterShard *m_next;
+};
+
+/// Collection of all counter shards
+class CounterShards {
+public:
+  /// Adds value to slot in shard of the current thread
+  static void add(uint slot, uint64 value)
+  {
+    current()->add(slot, value);
+  }
+  /// Returns sum of slot values from all shards
+  static uint64 getTotal(uint slot);
+  /// Calculates totals of slots [0, slotCount), output must have space for slotCount values
+  static void getTotals(uint slotCount, uint64 *output);
+  /// Calculates totals of selected slots, output must have space for slotCount values
+  static void getTotals(const uint *slots, uint slotCount, uint64 *output);
+  /// Sets slot to zero in all shards, slot cannot be updated by any thread at the same time
+  static void clearSlot(uint slot);
+  /// Returns shard of the current thread
+  static CounterShard *current()
+  {
+    CounterShard *res = m_current;
+    if (PERF_UNLIKELY(res == DTP_NULL))
+      res = attach();
+    return res;
+  }
+protected:
+  static CounterShard *attach();
+  static void retire(CounterShard *shard);
+private:
+  static PERF_THREAD_LOCAL CounterShard *m_current;
+  static CounterShard *m_active;
+  static CounterShard *m_retired;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFCOUNTERSHARDS_H__
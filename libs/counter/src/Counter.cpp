@@ -9,188 +9,1396 @@
 
 //#include "sc/defs.h"
 
-#include "base/wildcard.h"
 #include "base/string.h"
 
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
 #include "perf/Counter.h"
+#include "perf/time_utils.h"
+
+#ifdef PERF_COUNTER_USE_SHARDS
+#include "perf/details/CounterShards.h"
+#endif
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+
+// ----------------------------------------------------------------------------
+// Local definitions
+// ----------------------------------------------------------------------------
+// marks bucket being initialized
+const uint64 RATE_EPOCH_PENDING = (static_cast<uint64>(1) << 63);
+
+// Returns name of item used for reporting rate in a given window
+static dtpString rate_window_name(const dtpString &name, uint windowMs)
+{
+  char buffer[32];
+  if (windowMs % 1000 == 0)
+    sprintf(buffer, ".rate%us", windowMs / 1000);
+  else
+    sprintf(buffer, ".rate%ums", windowMs);
+  return name + buffer;
+}
+
+// Adds visited values as children of output node
+class CounterNodeBuilder: public CounterVisitorIntf {
+public:
+  CounterNodeBuilder(scDataNode &output): m_output(output) {}
+  virtual ~CounterNodeBuilder() {}
+  virtual void visit(const dtpString &name, uint64 value)
+  {
+    m_output.addChild(name, new scDataNode(value));
+  }
+  virtual void visitGauge(const dtpString &name, int64 value)
+  {
+    m_output.addChild(name, new scDataNode(value));
+  }
+  virtual void visitAggregate(const dtpString &name, const AggregateStats &stats)
+  {
+    m_output.addChild(name + ".count", new scDataNode(stats.count));
+    m_output.addChild(name + ".sum", new scDataNode(stats.sum));
+    m_output.addChild(name + ".min", new scDataNode(stats.min));
+    m_output.addChild(name + ".max", new scDataNode(stats.max));
+    m_output.addChild(name + ".mean", new scDataNode(stats.getMean()));
+  }
+  virtual void visitRate(const dtpString &name, uint windowMs, double eventsPerSec)
+  {
+    m_output.addChild(rate_window_name(name, windowMs), new scDataNode(eventsPerSec));
+  }
+  virtual void visitHistogram(const dtpString &name, const HistogramStats &stats)
+  {
+    m_output.addChild(name + ".count", new scDataNode(stats.count));
+    m_output.addChild(name + ".min", new scDataNode(stats.min));
+    m_output.addChild(name + ".mean", new scDataNode(stats.getMean()));
+    m_output.addChild(name + ".p50", new scDataNode(stats.p50));
+    m_output.addChild(name + ".p90", new scDataNode(stats.p90));
+    m_output.addChild(name + ".p99", new scDataNode(stats.p99));
+    m_output.addChild(name + ".p999", new scDataNode(stats.p999));
+    m_output.addChild(name + ".max", new scDataNode(stats.max));
+  }
+private:
+  scDataNode &m_output;
+};
+
+// Calculates sum of visited counters
+class CounterSumBuilder: public CounterVisitorIntf {
+public:
+  CounterSumBuilder() { m_sum = 0; }
+  virtual ~CounterSumBuilder() {}
+  virtual void visit(const dtpString &name, uint64 value)
+  {
+    m_sum += value;
+  }
+  uint64 getSum() const { return m_sum; }
+private:
+  uint64 m_sum;
+};
+
+static bool is_matching(CompiledFilter *filter, const dtpString &name)
+{
+  return (filter == DTP_NULL) || filter->isMatching(name);
+}
+
+static void build_filter(const scDataNode &filterList, CompiledFilter &output)
+{
+  output.clear();
+  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
+    output.addPattern(filterList.getString(j));
+}
+
+// ----------------------------------------------------------------------------
+// CounterSnapshot
+// ----------------------------------------------------------------------------
+dtpString CounterSnapshot::getName(uint index) const
+{
+  assert(index < size());
+  return Counter::getCounterName(index, m_generations[index]);
+}
+
+void CounterSnapshot::delta(const CounterSnapshot &prev, const CounterSnapshot &cur, CounterSnapshot &output)
+{
+  uint count = cur.size();
+  uint prevCount = (prev.size() < count) ? prev.size() : count;
+  CounterTotalColn &values = output.m_values;
+
+  values.resize(count);
+  output.m_generations = cur.m_generations;
+  output.m_timeMs = cur.m_timeMs;
+
+  uint64 prevValue, curValue;
+  for (uint i=0; i != prevCount; i++)
+  {
+    curValue = cur.m_values[i];
+    // index reused by a new counter
+    if (prev.m_generations[i] != cur.m_generations[i])
+    {
+      values[i] = curValue;
+      continue;
+    }
+    prevValue = prev.m_values[i];
+    values[i] = (curValue >= prevValue) ? (curValue - prevValue) : curValue;
+  }
+
+  // counters created after prev
+  for (uint i=prevCount; i != count; i++)
+    values[i] = cur.m_values[i];
+}
+
+// ----------------------------------------------------------------------------
+// CounterVisitorIntf
+// ----------------------------------------------------------------------------
+void CounterVisitorIntf::visitGauge(const dtpString &name, int64 value)
+{
+  // counters cannot be negative
+  visit(name, (value > 0) ? static_cast<uint64>(value) : 0);
+}
+
+void CounterVisitorIntf::visitAggregate(const dtpString &name, const AggregateStats &stats)
+{
+  visit(name + ".count", stats.count);
+  visit(name + ".sum", stats.sum);
+  visit(name + ".min", stats.min);
+  visit(name + ".max", stats.max);
+  visit(name + ".mean", static_cast<uint64>(stats.getMean() + 0.5));
+}
+
+void CounterVisitorIntf::visitRate(const dtpString &name, uint windowMs, double eventsPerSec)
+{
+  visit(rate_window_name(name, windowMs), static_cast<uint64>(eventsPerSec + 0.5));
+}
+
+void CounterVisitorIntf::visitTopK(const dtpString &name, const TopKEntryColn &entries)
+{
+  for(uint i=0, epos = entries.size(); i != epos; i++)
+    visit(name + ".top." + entries[i].key, entries[i].count);
+}
+
+void CounterVisitorIntf::visitHistogram(const dtpString &name, const HistogramStats &stats)
+{
+  visit(name + ".count", stats.count);
+  visit(name + ".min", stats.min);
+  visit(name + ".p50", stats.p50);
+  visit(name + ".p90", stats.p90);
+  visit(name + ".p99", stats.p99);
+  visit(name + ".p999", stats.p999);
+  visit(name + ".max", stats.max);
+}
+
+// ----------------------------------------------------------------------------
+// AggregateItem
+// ----------------------------------------------------------------------------
+void AggregateItem::record(uint64 value)
+{
+  uint64 curr;
+
+  Details::atomic_fetch_add(&m_count, static_cast<uint64>(1));
+  Details::atomic_fetch_add(&m_sum, value);
+
+  curr = Details::atomic_load(&m_min);
+  while((value < curr) && !Details::atomic_cas(&m_min, curr, value))
+    curr = Details::atomic_load(&m_min);
+
+  curr = Details::atomic_load(&m_max);
+  while((value > curr) && !Details::atomic_cas(&m_max, curr, value))
+    curr = Details::atomic_load(&m_max);
+}
+
+void AggregateItem::reset()
+{
+  Details::atomic_store(&m_count, static_cast<uint64>(0));
+  Details::atomic_store(&m_sum, static_cast<uint64>(0));
+  Details::atomic_store(&m_min, ~static_cast<uint64>(0));
+  Details::atomic_store(&m_max, static_cast<uint64>(0));
+}
+
+void AggregateItem::getStats(AggregateStats &output) const
+{
+  output.count = Details::atomic_load(&m_count);
+  output.sum = Details::atomic_load(&m_sum);
+  output.min = Details::atomic_load(&m_min);
+  output.max = Details::atomic_load(&m_max);
+  if (output.count == 0)
+    output.min = 0;
+}
+
+// ----------------------------------------------------------------------------
+// RateItem
+// ----------------------------------------------------------------------------
+RateItem::RateItem()
+{
+  const uint defWindows[] = {1000, 10000, 60000};
+  configure(RATE_DEF_BUCKET_MS, defWindows, 3);
+}
+
+void RateItem::configure(uint bucketMs, const uint *windowsMs, uint windowCount)
+{
+  assert(bucketMs > 0);
+  m_bucketMs = bucketMs;
+
+  if (windowCount > RATE_MAX_WINDOWS)
+    windowCount = RATE_MAX_WINDOWS;
+
+  uint maxWindowMs = (RATE_BUCKET_COUNT - 1) * bucketMs;
+  for(uint i=0; i != windowCount; i++)
+    m_windows[i] = (windowsMs[i] < maxWindowMs) ? windowsMs[i] : maxWindowMs;
+  m_windowCount = windowCount;
+
+  reset();
+}
+
+void RateItem::inc(uint64 value, uint64 nowMs)
+{
+  uint64 epoch = nowMs / m_bucketMs + 1;
+  uint64 prevTotal = Details::atomic_fetch_add(&m_total, value);
+  Bucket &bucket = m_buckets[epoch % RATE_BUCKET_COUNT];
+  uint64 stamp = Details::atomic_load_acquire(&bucket.epoch);
+
+  if (PERF_UNLIKELY(stamp != epoch))
+  {
+    // first event in bucket - rotate it
+    if (((stamp & ~RATE_EPOCH_PENDING) != epoch) && Details::atomic_cas(&bucket.epoch, stamp, epoch | RATE_EPOCH_PENDING))
+    {
+      Details::atomic_store(&bucket.start, prevTotal);
+      Details::atomic_store_release(&bucket.epoch, epoch);
+      return;
+    }
+    // Other thread rotates the bucket (or has reused it for a later epoch) - no waiting here.
+    // Event is already in total, at worst it is counted in the previous bucket.
+    stamp = Details::atomic_load_acquire(&bucket.epoch);
+    if (stamp != epoch)
+      return;
+  }
+
+  // event added to total before the winning rotation - move start of bucket back,
+  // so the event is counted in this bucket, not in the previous one
+  uint64 start = Details::atomic_load(&bucket.start);
+  while((prevTotal < start) && !Details::atomic_cas(&bucket.start, start, prevTotal))
+    start = Details::atomic_load(&bucket.start);
+}
+
+void RateItem::reset()
+{
+  for(uint i=0; i != RATE_BUCKET_COUNT; i++)
+  {
+    Details::atomic_store(&m_buckets[i].epoch, static_cast<uint64>(0));
+    Details::atomic_store(&m_buckets[i].start, static_cast<uint64>(0));
+  }
+  Details::atomic_store(&m_total, static_cast<uint64>(0));
+}
+
+uint64 RateItem::getFirstEpoch(uint windowMs, uint64 nowMs) const
+{
+  uint64 nowEpoch = nowMs / m_bucketMs + 1;
+  uint64 res = (nowMs >= windowMs) ? ((nowMs - windowMs) / m_bucketMs + 1) : 1;
+  if (nowEpoch - res >= RATE_BUCKET_COUNT)
+    res = nowEpoch - RATE_BUCKET_COUNT + 1;
+  return res;
+}
+
+uint64 RateItem::getSum(uint windowMs, uint64 nowMs) const
+{
+  uint64 nowEpoch = nowMs / m_bucketMs + 1;
+  uint64 start, total;
+
+  // find oldest bucket in window with any events
+  for(uint64 epoch = getFirstEpoch(windowMs, nowMs); epoch <= nowEpoch; epoch++)
+  {
+    const Bucket &bucket = m_buckets[epoch % RATE_BUCKET_COUNT];
+    if (Details::atomic_load_acquire(&bucket.epoch) != epoch)
+      continue;
+
+    start = Details::atomic_load(&bucket.start);
+    total = Details::atomic_load(&m_total);
+    return (total > start) ? (total - start) : 0;
+  }
+
+  return 0;
+}
+
+double RateItem::getRate(uint windowMs, uint64 nowMs) const
+{
+  uint64 spanMs = nowMs - (getFirstEpoch(windowMs, nowMs) - 1) * m_bucketMs;
+  if (spanMs == 0)
+    return 0.0;
+  return static_cast<double>(getSum(windowMs, nowMs)) * 1000.0 / static_cast<double>(spanMs);
+}
+
+// ----------------------------------------------------------------------------
+// TopKItem
+// ----------------------------------------------------------------------------
+TopKItem::TopKItem()
+{
+  m_total = 0;
+  m_capacity = TOPK_DEF_CAPACITY;
+  m_reportSize = TOPK_DEF_REPORT_SIZE;
+}
+
+void TopKItem::configure(uint capacity, uint reportSize)
+{
+  assert(capacity > 0);
+  m_capacity = capacity;
+  m_reportSize = reportSize;
+  reset();
+}
+
+void TopKItem::reset()
+{
+  m_heap.clear();
+  m_positions.clear();
+  m_total = 0;
+}
+
+void TopKItem::inc(const dtpString &key, uint64 value)
+{
+  m_total += value;
+
+  PositionMap::iterator it = m_positions.find(key);
+  if (it != m_positions.end())
+  {
+    m_heap[it->second].count += value;
+    siftDown(it->second);
+    return;
+  }
+
+  if (m_heap.size() < m_capacity)
+  {
+    TopKEntry entry;
+    entry.key = key;
+    entry.count = 0;
+    entry.error = 0;
+    m_heap.push_back(entry);
+
+    // new entry has the lowest count - move it to the root
+    uint pos = m_heap.size() - 1;
+    m_positions[key] = pos;
+    while(pos > 0)
+    {
+      uint parent = (pos - 1) / 2;
+      swapEntries(pos, parent);
+      pos = parent;
+    }
+  }
+  else
+  {
+    // replace key with the lowest count
+    TopKEntry &root = m_heap[0];
+    m_positions.erase(root.key);
+    root.key = key;
+    root.error = root.count;
+    m_positions[key] = 0;
+  }
+
+  m_heap[0].count += value;
+  siftDown(0);
+}
+
+void TopKItem::swapEntries(uint a, uint b)
+{
+  std::swap(m_heap[a], m_heap[b]);
+  m_positions[m_heap[a].key] = a;
+  m_positions[m_heap[b].key] = b;
+}
+
+void TopKItem::siftDown(uint pos)
+{
+  uint size = m_heap.size();
+  uint child;
+
+  while((child = pos * 2 + 1) < size)
+  {
+    if ((child + 1 < size) && (m_heap[child + 1].count < m_heap[child].count))
+      child++;
+    if (m_heap[pos].count <= m_heap[child].count)
+      break;
+    swapEntries(pos, child);
+    pos = child;
+  }
+}
+
+static bool topk_entry_greater(const TopKEntry &a, const TopKEntry &b)
+{
+  return a.count > b.count;
+}
+
+void TopKItem::getTop(uint k, TopKEntryColn &output) const
+{
+  output = m_heap;
+  if (k > output.size())
+    k = output.size();
+  std::partial_sort(output.begin(), output.begin() + k, output.end(), topk_entry_greater);
+  output.resize(k);
+}
+
+// ----------------------------------------------------------------------------
+// CounterBatch
+// ----------------------------------------------------------------------------
+void CounterBatch::assign(const CounterHandle *handles, uint count)
+{
+  m_items.resize(count);
+  m_runs.clear();
+
+  Run run;
+  for(uint i=0; i != count; i++)
+  {
+    assert(!handles[i].isNull());
+    CounterItem *item = handles[i].m_item;
+    m_items[i] = item;
+
+    if (!m_runs.empty() && (m_runs.back().slot + m_runs.back().count == item->getSlot()))
+      m_runs.back().count++;
+    else
+    {
+      run.slot = item->getSlot();
+      run.offset = i;
+      run.count = 1;
+      m_runs.push_back(run);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Details::SampleRandom
+// ----------------------------------------------------------------------------
+PERF_THREAD_LOCAL uint64 Details::SampleRandom::m_state = 0;
+volatile uint64 Details::SampleRandom::m_seedCount = 0;
+
+uint64 Details::SampleRandom::seed()
+{
+  // address of thread-local state differs between live threads, 
+  // sequence number between threads reusing the same address - no clock read
+  uint64 seq = Details::atomic_fetch_add(&m_seedCount, static_cast<uint64>(1));
+  uint64 res = static_cast<uint64>(reinterpret_cast<size_t>(&m_state)) ^ (seq * 0x9e3779b97f4a7c15ULL);
+  res ^= res >> 33;
+  res *= 0xff51afd7ed558ccdULL;
+  res ^= res >> 33;
+  return (res != 0) ? res : 1;
+}
+
+// ----------------------------------------------------------------------------
+// Counter
+// ----------------------------------------------------------------------------
+CounterItemMapColn Counter::m_items(true);
+GaugeItemMapColn Counter::m_gauges;
+AggregateItemMapColn Counter::m_aggregates;
+RateItemMapColn Counter::m_rates;
+HistogramItemMapColn Counter::m_histograms;
+TopKItemMapColn Counter::m_topK;
+Details::NameTrie Counter::m_names;
+Details::RejectedNameCache Counter::m_rejectedNames;
+Details::RejectedNameCache Counter::m_rejectedGauges;
+Details::RejectedNameCache Counter::m_rejectedAggregates;
+Details::RejectedNameCache Counter::m_rejectedRates;
+Details::RejectedNameCache Counter::m_rejectedHistograms;
+Details::RejectedNameCache Counter::m_rejectedTopK;
+Details::DirtyTracker Counter::m_changes;
+
+#ifndef PERF_COUNTER_USE_SHARDS
+void CounterItem::inc()
+{
+  m_total++;
+}
+
+void CounterItem::inc(uint64 value)
+{
+  if (value > 1000000000)
+    assert(false);
+  m_total += value;
+}
+#endif
+
+void CounterItem::reset()
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  Details::atomic_store(&m_total, Details::CounterShards::getTotal(m_slot));
+#else
+  m_total = 0;
+#endif
+}
+
+void CounterItem::restore(uint64 value)
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  // total = sum of shards - base
+  Details::atomic_fetch_add(&m_total, static_cast<uint64>(0) - value);
+#else
+  m_total += value;
+#endif
+}
+
+uint64 CounterItem::getTotal() const
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  return calcTotal(Details::CounterShards::getTotal(m_slot));
+#else
+  return m_total;
+#endif
+}
+
+uint64 CounterItem::calcTotal(uint64 shardTotal) const
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  return shardTotal - Details::atomic_load(&m_total);
+#else
+  return m_total;
+#endif
+}
+
+// items found by name can be removed concurrently - they are used inside epoch guard
+void Counter::inc(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  inc(CounterHandle(checkItem(a_name)));
+}
+
+void Counter::inc(const dtpString &a_name, uint64 value)
+{
+  Details::EpochGuard guard;
+  inc(CounterHandle(checkItem(a_name)), value);
+}
+
+void Counter::reset(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  reset(CounterHandle(checkItem(a_name)));
+}
+
+uint64 Counter::getTotal(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  return getTotal(CounterHandle(checkItem(a_name)));
+}
+
+bool Counter::setSampleRate(const dtpString &a_name, uint rate)
+{
+  uint value = 1;
+  while((value < COUNTER_MAX_SAMPLE_RATE) && (value * 2 <= rate))
+    value *= 2;
+
+  Details::EpochGuard guard;
+  CounterItem *item = checkItem(a_name);
+  // rate of overflow item would be applied to all names folded into it
+  if ((item == getItem(COUNTER_OVERFLOW_NAME)) && (a_name != COUNTER_OVERFLOW_NAME))
+    return false;
+  item->setSampleRate(value);
+  return true;
+}
+
+uint Counter::getSampleRate(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  return checkItem(a_name)->getSampleRate();
+}
+
+uint64 Counter::getErrorBound(CounterHandle handle)
+{
+  assert(!handle.isNull());
+  // recorded samples have binomial distribution: variance of scaled total ~ total * (rate - 1)
+  double rate = handle.m_item->getSampleRate();
+  double total = static_cast<double>(getTotal(handle));
+  return static_cast<uint64>(ceil(3.0 * sqrt(total * (rate - 1.0))));
+}
+
+void Counter::restore(const dtpString &a_name, uint64 value)
+{
+  Details::EpochGuard guard;
+  CounterItem *item = checkItem(a_name);
+#pragma omp critical(counter)
+{
+  item->restore(value);
+}
+  m_changes.mark(item->getSlot());
+}
+
+CounterHandle Counter::registerName(const dtpString &a_name)
+{
+  return CounterHandle(pinItem(a_name));
+}
+
+CounterBatch Counter::registerBatch(const dtpString *names, uint count)
+{
+  std::vector<CounterHandle> handles(count);
+  // one lock for all names, so new items get consecutive slots (unless slots of removed items are reused)
+#pragma omp critical(counter)
+{
+  for(uint i=0; i != count; i++)
+  {
+    CounterItem *item = getItem(names[i]);
+    if (!item)
+      item = addItem(names[i]);
+    item->pin();
+    handles[i] = CounterHandle(item);
+  }
+}
+  CounterBatch res;
+  if (count > 0)
+    res.assign(&handles[0], count);
+  return res;
+}
+
+void Counter::incBatch(const CounterHandle *handles, const uint64 *values, uint count)
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  Details::CounterShard *shard = Details::CounterShards::current();
+  for(uint i=0; i != count; i++)
+  {
+    assert(!handles[i].isNull());
+    shard->add(handles[i].m_item->getSlot(), values[i]);
+#ifdef PERF_COUNTER_TRACK_CHANGES
+    m_changes.mark(handles[i].m_item->getSlot());
+#endif
+  }
+#else
+#pragma omp critical(counter)
+{
+  for(uint i=0; i != count; i++)
+  {
+    handles[i].m_item->inc(values[i]);
+#ifdef PERF_COUNTER_TRACK_CHANGES
+    m_changes.mark(handles[i].m_item->getSlot());
+#endif
+  }
+}
+#endif
+}
+
+void Counter::incBatch(const CounterBatch &batch, const uint64 *values)
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  Details::CounterShard *shard = Details::CounterShards::current();
+  for(uint r=0, epos = batch.m_runs.size(); r != epos; r++)
+  {
+    const CounterBatch::Run &run = batch.m_runs[r];
+    shard->addRange(run.slot, values + run.offset, run.count);
+#ifdef PERF_COUNTER_TRACK_CHANGES
+    m_changes.markRange(run.slot, run.count);
+#endif
+  }
+#else
+#pragma omp critical(counter)
+{
+  for(uint i=0, epos = batch.m_items.size(); i != epos; i++)
+  {
+    batch.m_items[i]->inc(values[i]);
+#ifdef PERF_COUNTER_TRACK_CHANGES
+    m_changes.mark(batch.m_items[i]->getSlot());
+#endif
+  }
+}
+#endif
+}
+
+CounterItem *Counter::pinItem(const dtpString &a_name)
+{
+  CounterItem *res;
+  // under the same lock as remove(), so item cannot be removed before it is pinned
+#pragma omp critical(counter)
+{
+  res = getItem(a_name);
+  if (!res)
+    res = addItem(a_name);
+  res->pin();
+}
+  return res;
+}
+
+bool Counter::remove(const dtpString &a_name)
+{
+  CounterItemMapColn::Entry *entry = DTP_NULL;
+#pragma omp critical(counter)
+{
+  CounterItem *item = getItem(a_name);
+  if ((item != DTP_NULL) && !item->isPinned())
+  {
+    entry = m_items.remove(a_name);
+    m_names.remove(a_name, entry->index);
+    // rejected names can fit again after enough removals
+    m_rejectedNames.release();
+  }
+}
+  if (entry == DTP_NULL)
+    return false;
+
+  Details::Epoch::retire(entry, &Counter::releaseItem);
+  Details::Epoch::reclaim();
+  return true;
+}
+
+uint Counter::removeByFilter(const scDataNode &filterList)
+{
+  CompiledFilter filter;
+  build_filter(filterList, filter);
+  return removeByFilter(filter);
+}
+
+uint Counter::removeByFilter(CompiledFilter &filter)
+{
+  std::vector<dtpString> names;
+  {
+    Details::EpochGuard guard;
+    const CounterItemMapColn::Entry *entry;
+    for (uint i=0, epos = m_items.size(); i != epos; i++)
+    {
+      entry = m_items.at(i);
+      if ((entry != DTP_NULL) && !entry->value->isPinned() && filter.isMatching(entry->name))
+        names.push_back(entry->name);
+    }
+  }
+
+  uint res = 0;
+  for (uint i=0, epos = names.size(); i != epos; i++)
+    if (remove(names[i]))
+      res++;
+  return res;
+}
+
+void Counter::releaseItem(void *entry)
+{
+  CounterItemMapColn::Entry *removed = static_cast<CounterItemMapColn::Entry *>(entry);
+#ifdef PERF_COUNTER_USE_SHARDS
+  // slot must be empty before it is reused
+  Details::CounterShards::clearSlot(removed->value->getSlot());
+#endif
+#pragma omp critical(counter)
+{
+  m_items.release(removed);
+}
+}
+
+CounterItem *Counter::resolveItem(Details::StaticCounterRef &ref, const char *a_name)
+{
+  CounterItem *res = pinItem(a_name);
+  // concurrent resolves of the same name store the same values
+  ref.name = a_name;
+  Details::atomic_store_release(&ref.item, res);
+  return res;
+}
+
+void Counter::reset(CounterHandle handle)
+{
+  assert(!handle.isNull());
+#ifdef PERF_COUNTER_USE_SHARDS
+  handle.m_item->reset();
+#else
+#pragma omp critical(counter)
+{
+  handle.m_item->reset();
+}
+#endif
+#ifdef PERF_COUNTER_TRACK_CHANGES
+  m_changes.mark(handle.m_item->getSlot());
+#endif
+}
+
+uint64 Counter::getTotal(CounterHandle handle)
+{
+  assert(!handle.isNull());
+  uint64 res;
+#ifdef PERF_COUNTER_USE_SHARDS
+  res = handle.m_item->getTotal();
+#else
+#pragma omp critical(counter)
+{
+  res = handle.m_item->getTotal();
+}
+#endif
+  return res;
+}
+
+void Counter::prepareTotals(CounterTotalColn &output)
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  output.resize(m_items.size());
+  if (!output.empty())
+    Details::CounterShards::getTotals(output.size(), &output[0]);
+#else
+  output.clear();
+#endif
+}
 
-#ifdef DEBUG_MEM
-#include "dbg/DebugMem.h"
+void Counter::prepareTotals(const std::vector<uint> &slots, CounterTotalColn &output)
+{
+  output.assign(slots.size(), 0);
+#ifdef PERF_COUNTER_USE_SHARDS
+  if (!slots.empty())
+    Details::CounterShards::getTotals(&slots[0], slots.size(), &output[0]);
 #endif
+}
 
-using namespace perf;
+uint64 Counter::getItemTotal(const CounterItem &item, const CounterTotalColn &totals)
+{
+#ifdef PERF_COUNTER_USE_SHARDS
+  // items added after totals were prepared are not included in <totals>
+  if (item.getSlot() < totals.size())
+    return item.calcTotal(totals[item.getSlot()]);
+#endif
+  return item.getTotal();
+}
 
-// ----------------------------------------------------------------------------
-// Counter
-// ----------------------------------------------------------------------------
-CounterItemMapColn Counter::m_items;
+CounterItem *Counter::addItem(const dtpString &a_name)
+{
+  bool full = !m_items.canInsert(a_name, m_names.getMemoryUsage() + m_names.insertCost(a_name));
+#ifdef PERF_COUNTER_USE_SHARDS
+  // upper part of shard slots is used by labelled counters
+  full = full || (m_items.nextIndex() >= Details::COUNTER_SHARD_MAX_SLOTS - COUNTER_MAX_SERIES);
+#endif
+  if (full)
+    return rejectName(m_items, m_rejectedNames, a_name, Details::name_hash(a_name));
 
-void CounterItem::inc()
+  CounterItem *item = new CounterItem();
+  item->setSlot(m_items.nextIndex());
+  m_items.insert(a_name, Details::name_hash(a_name), item);
+  m_names.insert(a_name, item->getSlot());
+  m_changes.mark(item->getSlot());
+  return item;
+}
+
+template<typename T>
+T *Counter::rejectName(Details::NameRegistry<T> &registry, Details::RejectedNameCache &rejectedNames,
+  const dtpString &a_name, uint64 hash)
 {
-  m_total++;
+  // overflow items are registered by setCapacity
+  T *overflow = registry.find(COUNTER_OVERFLOW_NAME);
+  CounterItem *rejected = m_items.find(COUNTER_REJECTED_NAME);
+  if ((overflow == DTP_NULL) || (rejected == DTP_NULL))
+    throw std::length_error("too many counters");
+  // name is counted again only if it could not be cached
+  if (!rejectedNames.contains(a_name, hash))
+  {
+    rejectedNames.insert(a_name, hash);
+    rejected->inc();
+  }
+  return overflow;
 }
 
-void CounterItem::inc(uint64 value)
+template<typename T>
+T *Counter::checkNamedItem(Details::NameRegistry<T> &registry, Details::RejectedNameCache &rejectedNames,
+  const dtpString &a_name)
 {
-  if (value > 1000000000)
-    assert(false);
-  m_total += value;
+  uint64 hash = Details::name_hash(a_name);
+  T *res = registry.find(a_name, hash);
+  if (res != DTP_NULL)
+    return res;
+
+  // names rejected before go to overflow item without the lock
+  if (rejectedNames.contains(a_name, hash))
+    return registry.find(COUNTER_OVERFLOW_NAME);
+  // cache of rejected names is full and registry too, new name is counted without the lock
+  if (rejectedNames.isOverflowing())
+  {
+    m_items.find(COUNTER_REJECTED_NAME)->inc();
+    return registry.find(COUNTER_OVERFLOW_NAME);
+  }
+
+#pragma omp critical(counter)
+{
+  res = registry.find(a_name, hash);
+  if (res == DTP_NULL)
+  {
+    if (registry.canInsert(a_name))
+      res = registry.insert(a_name, hash, new T());
+    else
+      res = rejectName(registry, rejectedNames, a_name, hash);
+  }
+}
+  return res;
 }
 
-void CounterItem::reset()
+template<typename T>
+void Counter::setNamedCapacity(Details::NameRegistry<T> &registry, Details::RejectedNameCache &rejectedNames,
+  uint maxItems, size_t maxMemory)
 {
-  m_total = 0;
+  if (registry.find(COUNTER_OVERFLOW_NAME) == DTP_NULL)
+    registry.insert(COUNTER_OVERFLOW_NAME, Details::name_hash(COUNTER_OVERFLOW_NAME), new T());
+  registry.setLimits(maxItems, maxMemory);
+  rejectedNames.clear();
 }
 
-uint64 CounterItem::getTotal() const
+void Counter::setCapacity(uint maxItems, size_t maxMemory)
 {
-  return m_total;
+  pinItem(COUNTER_OVERFLOW_NAME);
+  pinItem(COUNTER_REJECTED_NAME);
+#pragma omp critical(counter)
+{
+  m_items.setLimits(maxItems, maxMemory);
+  m_rejectedNames.clear();
+  setNamedCapacity(m_gauges, m_rejectedGauges, maxItems, maxMemory);
+  setNamedCapacity(m_aggregates, m_rejectedAggregates, maxItems, maxMemory);
+  setNamedCapacity(m_rates, m_rejectedRates, maxItems, maxMemory);
+  setNamedCapacity(m_histograms, m_rejectedHistograms, maxItems, maxMemory);
+  setNamedCapacity(m_topK, m_rejectedTopK, maxItems, maxMemory);
+}
 }
 
-typedef boost::ptr_map<dtpString,CounterItem> CounterItemMapColn;
+uint64 Counter::getRejectedCount()
+{
+  Details::EpochGuard guard;
+  CounterItem *item = getItem(COUNTER_REJECTED_NAME);
+  return (item != DTP_NULL) ? item->getTotal() : 0;
+}
 
-void Counter::inc(const dtpString &a_name)
+CounterItem *Counter::getItem(const dtpString &a_name)
 {
-  CounterItem *item = checkItem(a_name);
+  return m_items.find(a_name);
+}
+
+CounterItem *Counter::checkItem(const dtpString &a_name)
+{
+  // lock-free lookup, existing items are found here in almost every call
+  uint64 hash = Details::name_hash(a_name);
+  CounterItem *res = m_items.find(a_name, hash);
+  // names rejected before go to overflow item without the lock
+  if ((res == DTP_NULL) && m_rejectedNames.contains(a_name, hash))
+    res = getItem(COUNTER_OVERFLOW_NAME);
+  // cache of rejected names is full and registry too, new name is counted without the lock
+  if ((res == DTP_NULL) && m_rejectedNames.isOverflowing())
+  {
+    getItem(COUNTER_REJECTED_NAME)->inc();
+    res = getItem(COUNTER_OVERFLOW_NAME);
+  }
+  if (res == DTP_NULL)
+  {
 #pragma omp critical(counter)
 {
-  item->inc(1);
+    res = getItem(a_name);
+    if (!res)
+      res = addItem(a_name);
+}
+  }
+  assert(res != DTP_NULL);
+  return res;
 }
+
+GaugeItem *Counter::checkGauge(const dtpString &a_name)
+{
+  return checkNamedItem(m_gauges, m_rejectedGauges, a_name);
 }
 
-void Counter::inc(const dtpString &a_name, uint64 value)
+AggregateItem *Counter::checkAggregate(const dtpString &a_name)
 {
-  CounterItem *item = checkItem(a_name);
-#pragma omp critical(counter)
+  return checkNamedItem(m_aggregates, m_rejectedAggregates, a_name);
+}
+
+RateItem *Counter::checkRate(const dtpString &a_name)
 {
-  item->inc(value);
+  return checkNamedItem(m_rates, m_rejectedRates, a_name);
 }
+
+Histogram *Counter::checkHistogram(const dtpString &a_name)
+{
+  return checkNamedItem(m_histograms, m_rejectedHistograms, a_name);
 }
 
-void Counter::reset(const dtpString &a_name)
+TopKItem *Counter::checkTopK(const dtpString &a_name)
 {
-  CounterItem *item = checkItem(a_name);
-#pragma omp critical(counter)
+  return checkNamedItem(m_topK, m_rejectedTopK, a_name);
+}
+
+void Counter::setGauge(const dtpString &a_name, int64 value)
 {
-  item->reset();
+  checkGauge(a_name)->set(value);
 }
+
+void Counter::addGauge(const dtpString &a_name, int64 value)
+{
+  checkGauge(a_name)->add(value);
 }
 
-uint64 Counter::getTotal(const dtpString &a_name)
+void Counter::subGauge(const dtpString &a_name, int64 value)
 {
-  CounterItem *item = checkItem(a_name);
-  uint64 res;
+  checkGauge(a_name)->sub(value);
+}
+
+int64 Counter::getGauge(const dtpString &a_name)
+{
+  return checkGauge(a_name)->getValue();
+}
+
+void Counter::record(const dtpString &a_name, uint64 value)
+{
+  checkAggregate(a_name)->record(value);
+}
+
+void Counter::resetStats(const dtpString &a_name)
+{
+  checkAggregate(a_name)->reset();
+}
+
+void Counter::getStats(const dtpString &a_name, AggregateStats &output)
+{
+  checkAggregate(a_name)->getStats(output);
+}
+
+void Counter::incRate(const dtpString &a_name, uint64 value)
+{
+  checkRate(a_name)->inc(value, os_uptime_ms());
+}
+
+double Counter::getRate(const dtpString &a_name, uint windowMs)
+{
+  return checkRate(a_name)->getRate(windowMs, os_uptime_ms());
+}
+
+bool Counter::configureRate(const dtpString &a_name, uint bucketMs, const uint *windowsMs, uint windowCount)
+{
+  bool res = false;
+  // layout of buckets is not synchronized with increments & readers, 
+  // so item is configured before it is published
 #pragma omp critical(counter)
 {
-  res = item->getTotal();
+  if ((m_rates.find(a_name) == DTP_NULL) && m_rates.canInsert(a_name))
+  {
+    RateItem *item = new RateItem();
+    item->configure(bucketMs, windowsMs, windowCount);
+    m_rates.insert(a_name, Details::name_hash(a_name), item);
+    res = true;
+  }
 }
   return res;
 }
 
-CounterItem *Counter::addItem(const dtpString &a_name)
+void Counter::recordHistogram(const dtpString &a_name, uint64 value)
 {
-  std::auto_ptr<CounterItem> guard(new CounterItem());
-  m_items.insert(const_cast<dtpString &>(a_name), guard.get());
-  return guard.release();
+  checkHistogram(a_name)->record(value);
 }
 
-CounterItem *Counter::getItem(const dtpString &a_name)
+void Counter::mergeHistogram(const dtpString &a_name, const Histogram &src)
 {
-  CounterItemMapColn::iterator p;
+  checkHistogram(a_name)->merge(src);
+}
 
-  p = m_items.find(a_name);
-  if(p != m_items.end())
-    return (p->second);
-  else
-    return DTP_NULL;
+void Counter::resetHistogram(const dtpString &a_name)
+{
+  checkHistogram(a_name)->reset();
 }
 
-CounterItem *Counter::checkItem(const dtpString &a_name)
+void Counter::getHistogram(const dtpString &a_name, HistogramStats &output)
+{
+  checkHistogram(a_name)->getStats(output);
+}
+
+uint64 Counter::getPercentile(const dtpString &a_name, double percent)
+{
+  return checkHistogram(a_name)->getPercentile(percent);
+}
+
+void Counter::incTopK(const dtpString &a_name, const dtpString &key, uint64 value)
+{
+  TopKItem *item = checkTopK(a_name);
+#pragma omp critical(counter_topk)
+{
+  item->inc(key, value);
+}
+}
+
+void Counter::getTopK(const dtpString &a_name, uint k, TopKEntryColn &output)
+{
+  TopKItem *item = checkTopK(a_name);
+#pragma omp critical(counter_topk)
+{
+  item->getTop(k, output);
+}
+}
+
+void Counter::resetTopK(const dtpString &a_name)
+{
+  TopKItem *item = checkTopK(a_name);
+#pragma omp critical(counter_topk)
+{
+  item->reset();
+}
+}
+
+void Counter::configureTopK(const dtpString &a_name, uint capacity, uint reportSize)
+{
+  TopKItem *item = checkTopK(a_name);
+#pragma omp critical(counter_topk)
+{
+  item->configure(capacity, reportSize);
+}
+}
+
+void Counter::findByPrefix(const dtpString &prefix, std::vector<uint> &output)
 {
-  CounterItem *res;
 #pragma omp critical(counter)
 {
-  res = getItem(a_name);
-  if (!res)
-    res = addItem(a_name);
+  m_names.findByPrefix(prefix, output);
 }
-  assert(res != DTP_NULL);
-  return res;
 }
 
-void Counter::visitAll(CounterVisitorIntf *visitor)
+void Counter::visitMatching(CounterVisitorIntf *visitor, CompiledFilter *filter)
 {
-  uint64 itemTotal;
-  for (CounterItemMapColn::iterator p = m_items.begin(); p != m_items.end(); p++)
+  // delete items removed since previous visit
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+  CounterTotalColn totals;
+  std::vector<uint> indexes;
+  bool scanAll = true;
+
+  if (filter != DTP_NULL)
   {
-    itemTotal = p->second->getTotal();
-    visitor->visit(p->first, itemTotal);
+    // counters: only subtrees of literal prefixes of patterns are checked
+    scanAll = false;
+    for(uint j=0, eposj = filter->getPatternCount(); j != eposj; j++)
+    {
+      dtpString prefix = Details::wildcard_prefix(filter->getPattern(j));
+      if (prefix.empty())
+      {
+        scanAll = true;
+        break;
+      }
+      findByPrefix(prefix, indexes);
+    }
   }
-}
 
-void Counter::getAll(scDataNode &output)
-{
-  uint64 itemTotal;
+  if (scanAll)
+  {
+    prepareTotals(totals);
+    for (uint i=0, epos = m_items.size(); i != epos; i++)
+    {
+      const CounterItemMapColn::Entry *entry = m_items.at(i);
+      if ((entry != DTP_NULL) && is_matching(filter, entry->name))
+        visitor->visit(entry->name, getItemTotal(*(entry->value), totals));
+    }
+  }
+  else
+  {
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+    prepareTotals(indexes, totals);
 
-  output.clear();
-  output.setAsParent();
+    for (uint i=0, epos = indexes.size(); i != epos; i++)
+    {
+      const CounterItemMapColn::Entry *entry = m_items.at(indexes[i]);
+      if ((entry != DTP_NULL) && is_matching(filter, entry->name))
+        visitor->visit(entry->name, entry->value->calcTotal(totals[i]));
+    }
+  }
+
+  for (uint i=0, epos = m_gauges.size(); i != epos; i++)
+  {
+    const GaugeItemMapColn::Entry *entry = m_gauges.at(i);
+    if (is_matching(filter, entry->name))
+      visitor->visitGauge(entry->name, entry->value->getValue());
+  }
+
+  AggregateStats stats;
+  for (uint i=0, epos = m_aggregates.size(); i != epos; i++)
+  {
+    const AggregateItemMapColn::Entry *entry = m_aggregates.at(i);
+    if (is_matching(filter, entry->name))
+    {
+      entry->value->getStats(stats);
+      visitor->visitAggregate(entry->name, stats);
+    }
+  }
+
+  uint64 nowMs = os_uptime_ms();
+  for (uint i=0, epos = m_rates.size(); i != epos; i++)
+  {
+    const RateItemMapColn::Entry *entry = m_rates.at(i);
+    if (is_matching(filter, entry->name))
+    {
+      const RateItem *item = entry->value;
+      for(uint j=0, eposj = item->getWindowCount(); j != eposj; j++)
+        visitor->visitRate(entry->name, item->getWindow(j), item->getRate(item->getWindow(j), nowMs));
+    }
+  }
+
+  HistogramStats histStats;
+  for (uint i=0, epos = m_histograms.size(); i != epos; i++)
+  {
+    const HistogramItemMapColn::Entry *entry = m_histograms.at(i);
+    if (is_matching(filter, entry->name))
+    {
+      entry->value->getStats(histStats);
+      visitor->visitHistogram(entry->name, histStats);
+    }
+  }
 
-  for (CounterItemMapColn::iterator p = m_items.begin(); p != m_items.end(); p++)
+  TopKEntryColn topEntries;
+  for (uint i=0, epos = m_topK.size(); i != epos; i++)
   {
-    itemTotal = p->second->getTotal();
-    output.addChild(p->first, new scDataNode(itemTotal));
+    const TopKItemMapColn::Entry *entry = m_topK.at(i);
+    if (is_matching(filter, entry->name))
+    {
+      const TopKItem *item = entry->value;
+#pragma omp critical(counter_topk)
+{
+      item->getTop(item->getReportSize(), topEntries);
+}
+      visitor->visitTopK(entry->name, topEntries);
+    }
   }
+
+  visitSeries(visitor, filter);
 }
 
-scDataNode Counter::removeNonMatching(const scDataNode &input, const scDataNode &filterList)
+void Counter::takeSnapshot(CounterSnapshot &output)
 {
-  scDataNode res;
-  dtpString name;
-  bool found;
-  res.setAsParent();
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+  CounterTotalColn &values = output.m_values;
+  std::vector<uint> &generations = output.m_generations;
+  const CounterItemMapColn::Entry *entry;
 
-  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
+  output.m_timeMs = os_uptime_ms();
+
+  // Entries are read before shard totals. Slot is cleared before it's index is reused
+  // and entries seen here cannot be released before guard ends, so totals read later 
+  // do not include leftovers of a counter removed in the meantime.
+  uint count = m_items.size();
+  generations.resize(count);
+  for (uint i=0; i != count; i++)
   {
-    WildcardMatcher matcher(filterList.getString(j));
+    entry = m_items.at(i);
+    generations[i] = (entry == DTP_NULL) ? COUNTER_REMOVED_GENERATION : entry->generation;
+  }
+
+  prepareTotals(values);
+  values.resize(count);
 
-    for(uint i=0, epos = input.size(); i != epos; i++)
+  // item slot is equal to it's index in registry
+  for (uint i=0; i != count; i++)
+  {
+    entry = m_items.at(i);
+    // index reused or removed after first pass
+    if ((entry == DTP_NULL) || (entry->generation != generations[i]))
     {
-      name = input.getElementName(i);
-      if (!res.hasChild(name) && matcher.isMatching(name) )
-        res.addChild(name, new scDataNode(input.getElement(i)));
+      values[i] = 0;
+      generations[i] = COUNTER_REMOVED_GENERATION;
+    } else {
+      values[i] = getItemTotal(*(entry->value), values);
     }
   }
+}
+
+dtpString Counter::getCounterName(uint index, uint generation)
+{
+  Details::EpochGuard guard;
+  const CounterItemMapColn::Entry *entry = (index < m_items.size()) ? m_items.at(index) : DTP_NULL;
+  if ((entry == DTP_NULL) || (entry->generation != generation))
+    return dtpString();
+  return entry->name;
+}
+
+void Counter::visitByPrefix(const dtpString &prefix, CounterVisitorIntf *visitor)
+{
+  Details::EpochGuard guard;
+  std::vector<uint> indexes;
+  findByPrefix(prefix, indexes);
+  if (indexes.empty())
+    return;
+
+  std::sort(indexes.begin(), indexes.end());
+
+  CounterTotalColn totals;
+  prepareTotals(indexes, totals);
+
+  for (uint i=0, epos = indexes.size(); i != epos; i++)
+  {
+    const CounterItemMapColn::Entry *entry = m_items.at(indexes[i]);
+    if (entry != DTP_NULL)
+      visitor->visit(entry->name, entry->value->calcTotal(totals[i]));
+  }
+}
+
+uint64 Counter::getTotalByPrefix(const dtpString &prefix)
+{
+  CounterSumBuilder builder;
+  visitByPrefix(prefix, &builder);
+  return builder.getSum();
+}
+
+void Counter::visitAll(CounterVisitorIntf *visitor)
+{
+  visitMatching(visitor, DTP_NULL);
+}
+
+uint64 Counter::visitChanged(uint64 since, CounterVisitorIntf *visitor)
+{
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+  std::vector<uint> indexes;
+  bool complete;
+  uint64 res = m_changes.getChanged(since, indexes, complete);
+#ifndef PERF_COUNTER_TRACK_CHANGES
+  // increments are not tracked
+  complete = false;
+#endif
+
+  uint count = m_items.size();
+  if (!complete)
+  {
+    indexes.resize(count);
+    for (uint i=0; i != count; i++)
+      indexes[i] = i;
+  }
+  else
+  {
+    // slots of labelled series are above registry range
+    indexes.erase(std::lower_bound(indexes.begin(), indexes.end(), count), indexes.end());
+  }
 
+  CounterTotalColn totals;
+  prepareTotals(indexes, totals);
+
+  for (uint i=0, epos = indexes.size(); i != epos; i++)
+  {
+    const CounterItemMapColn::Entry *entry = m_items.at(indexes[i]);
+    if (entry != DTP_NULL)
+      visitor->visit(entry->name, entry->value->calcTotal(totals[i]));
+  }
   return res;
 }
 
-void Counter::getByFilter(const scDataNode &filterList, scDataNode &output)
+void Counter::getAll(scDataNode &output)
 {
   output.clear();
   output.setAsParent();
 
-  dtpString itemName;
-
-  if (m_items.empty())
-    return;
+  CounterNodeBuilder builder(output);
+  visitMatching(&builder, DTP_NULL);
+}
 
-  boost::ptr_vector<WildcardMatcher> matchers;
+scDataNode Counter::removeNonMatching(const scDataNode &input, const scDataNode &filterList)
+{
+  scDataNode res;
+  dtpString name;
+  CompiledFilter filter;
 
-  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
-    matchers.push_back(new WildcardMatcher(filterList.getString(j)));
+  res.setAsParent();
+  build_filter(filterList, filter);
 
-  for (CounterItemMapColn::iterator p = m_items.begin(); p != m_items.end(); p++)
+  for(uint i=0, epos = input.size(); i != epos; i++)
   {
-      itemName = p->first;
-      for(uint j=0, eposj = matchers.size(); j != eposj; j++)
-      {
-        if (matchers[j].isMatching(itemName))
-        {
-          output.addChild(itemName, new scDataNode(p->second->getTotal()));
-          break;
-        }
-      }
+    name = input.getElementName(i);
+    if (filter.isMatching(name) && !res.hasChild(name))
+      res.addChild(name, new scDataNode(input.getElement(i)));
   }
+
+  return res;
+}
+
+void Counter::getByFilter(const scDataNode &filterList, scDataNode &output)
+{
+  CompiledFilter filter;
+  build_filter(filterList, filter);
+  getByFilter(filter, output);
+}
+
+void Counter::getByFilter(CompiledFilter &filter, scDataNode &output)
+{
+  output.clear();
+  output.setAsParent();
+
+  CounterNodeBuilder builder(output);
+  visitMatching(&builder, &filter);
 }
 
 // ----------------------------------------------------------------------------
@@ -206,30 +1414,26 @@ LocalCounter::~LocalCounter()
 
 void LocalCounter::inc(const dtpString &a_name, uint value)
 {
-  if (!m_values.hasChild(a_name))
-    m_values.addChild(a_name, new scDataNode(value));
-  else
-    m_values.setUInt64(a_name, m_values.getUInt64(a_name) + value);
+  m_values.get(a_name) += value;
 }
 
 void LocalCounter::inc(const dtpString &a_name, uint64 value)
 {
-  if (!m_values.hasChild(a_name))
-    m_values.addChild(a_name, new scDataNode(value));
-  else
-    m_values.setUInt64(a_name, m_values.getUInt64(a_name) + value);
+  m_values.get(a_name) += value;
 }
 
 void LocalCounter::reset(const dtpString &a_name)
 {
-  if (m_values.hasChild(a_name))
-    m_values.setUInt64(a_name, 0);
+  uint64 *value = m_values.find(a_name);
+  if (value != DTP_NULL)
+    *value = 0;
 }
 
 uint64 LocalCounter::getTotal(const dtpString &a_name)
 {
-  if (m_values.hasChild(a_name))
-    return m_values.getUInt64(a_name);
+  uint64 *value = m_values.find(a_name);
+  if (value != DTP_NULL)
+    return *value;
   else
     return 0;
 }
@@ -241,6 +1445,9 @@ void LocalCounter::clear()
 
 void LocalCounter::getAll(scDataNode &output)
 {
-  output = m_values;
-}
+  output.clear();
+  output.setAsParent();
 
+  for(uint i=0, epos = m_values.size(); i != epos; i++)
+    output.addChild(m_values.at(i).name, new scDataNode(m_values.at(i).value));
+}
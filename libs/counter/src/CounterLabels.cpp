@@ -0,0 +1,260 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CounterLabels.cpp
+// Project:     perfLib
+// Purpose:     Labelled (dimensional) counters
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdexcept>
+
+#include "perf/Counter.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+
+// ----------------------------------------------------------------------------
+// Local definitions
+// ----------------------------------------------------------------------------
+// Series key is a sequence of 4-byte ids: family, label values
+const uint SERIES_ID_SIZE = 4;
+
+static void append_id(dtpString &key, uint id)
+{
+  for(uint i=0; i != SERIES_ID_SIZE; i++)
+    key += static_cast<char>((id >> (i * 8)) & 0xff);
+}
+
+static uint read_id(const dtpString &key, uint pos)
+{
+  uint res = 0;
+  for(uint i=0; i != SERIES_ID_SIZE; i++)
+    res |= static_cast<uint>(static_cast<unsigned char>(key[pos * SERIES_ID_SIZE + i])) << (i * 8);
+  return res;
+}
+
+#ifdef PERF_COUNTER_USE_SHARDS
+// Series use shard slots from the top of slot range, named counters from the bottom
+static uint series_slot(uint index)
+{
+  return Details::COUNTER_SHARD_MAX_SLOTS - 1 - index;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// CounterLabelSnapshot
+// ----------------------------------------------------------------------------
+void CounterLabelSnapshot::sumByLabel(CounterFamily family, uint labelIndex, CounterLabelTotalColn &output) const
+{
+  assert(labelIndex < family.getLabelCount());
+  for(uint i=0, epos = m_series.size(); i != epos; i++)
+  {
+    const Series &series = m_series[i];
+    if (series.family == family.getId())
+      output[series.labels[labelIndex]] += series.value;
+  }
+}
+
+uint64 CounterLabelSnapshot::getFamilyTotal(CounterFamily family) const
+{
+  uint64 res = 0;
+  for(uint i=0, epos = m_series.size(); i != epos; i++)
+    if (m_series[i].family == family.getId())
+      res += m_series[i].value;
+  return res;
+}
+
+// ----------------------------------------------------------------------------
+// CounterVisitorIntf
+// ----------------------------------------------------------------------------
+void CounterVisitorIntf::visitSeries(const dtpString &family, const CounterLabel *labels, uint labelCount, uint64 value)
+{
+  dtpString name(family);
+  name += '{';
+  for(uint i=0; i != labelCount; i++)
+  {
+    if (i > 0)
+      name += ',';
+    name += *(labels[i].key);
+    name += '=';
+    name += *(labels[i].value);
+  }
+  name += '}';
+  visit(name, value);
+}
+
+// ----------------------------------------------------------------------------
+// Counter - labelled counters
+// ----------------------------------------------------------------------------
+CounterSymbolMapColn Counter::m_symbols;
+CounterFamilyMapColn Counter::m_families;
+CounterSeriesMapColn Counter::m_series;
+
+uint Counter::internSymbol(const dtpString &a_name)
+{
+  uint64 hash = Details::name_hash(a_name);
+  uint *res = m_symbols.find(a_name, hash);
+  if (res == DTP_NULL)
+  {
+#pragma omp critical(counter)
+{
+    res = m_symbols.find(a_name, hash);
+    if (!res)
+      res = m_symbols.insert(a_name, hash, new uint(m_symbols.size()));
+}
+  }
+  return *res;
+}
+
+const dtpString &Counter::getSymbol(uint id)
+{
+  return m_symbols.at(id)->name;
+}
+
+CounterFamily Counter::registerFamily(const dtpString &a_name, const dtpString *labelKeys, uint labelCount)
+{
+  assert(labelCount <= COUNTER_MAX_LABELS);
+  if (labelCount > COUNTER_MAX_LABELS)
+    throw std::invalid_argument("too many counter labels");
+
+  std::vector<uint> keys(labelCount);
+  for(uint i=0; i != labelCount; i++)
+    keys[i] = internSymbol(labelKeys[i]);
+
+  uint64 hash = Details::name_hash(a_name);
+  CounterFamilyItem *res = m_families.find(a_name, hash);
+  if (res == DTP_NULL)
+  {
+#pragma omp critical(counter)
+{
+    res = m_families.find(a_name, hash);
+    if (!res)
+    {
+      CounterFamilyItem *item = new CounterFamilyItem();
+      item->id = m_families.size();
+      item->keys = keys;
+      res = m_families.insert(a_name, hash, item);
+    }
+}
+  }
+
+  // family registered again must have the same labels
+  if (res->keys != keys)
+    throw std::invalid_argument("counter family registered with different labels");
+  return CounterFamily(res->id, res->keys.size());
+}
+
+const dtpString &Counter::getFamilyName(CounterFamily family)
+{
+  assert(!family.isNull());
+  return m_families.at(family.getId())->name;
+}
+
+CounterItem *Counter::checkSeries(uint familyId, const dtpString *labelValues, uint labelCount)
+{
+  dtpString key;
+  key.reserve((labelCount + 1) * SERIES_ID_SIZE);
+  append_id(key, familyId);
+  for(uint i=0; i != labelCount; i++)
+    append_id(key, internSymbol(labelValues[i]));
+
+  uint64 hash = Details::name_hash(key);
+  CounterItem *res = m_series.find(key, hash);
+  if (res == DTP_NULL)
+  {
+#pragma omp critical(counter)
+{
+    res = m_series.find(key, hash);
+    if (!res && (m_series.size() < COUNTER_MAX_SERIES))
+    {
+      CounterItem *item = new CounterItem();
+#ifdef PERF_COUNTER_USE_SHARDS
+      item->setSlot(series_slot(m_series.size()));
+#endif
+      res = m_series.insert(key, hash, item);
+    }
+}
+  }
+
+  if (res == DTP_NULL)
+    throw std::length_error("too many counter series");
+  return res;
+}
+
+CounterHandle Counter::registerSeries(CounterFamily family, const dtpString *labelValues, uint labelCount)
+{
+  // label ids are copied to fixed-size arrays (snapshot, visitSeries)
+  if (family.isNull() || (labelCount != family.getLabelCount()))
+    throw std::invalid_argument("counter label count does not match family");
+  return CounterHandle(checkSeries(family.getId(), labelValues, labelCount));
+}
+
+void Counter::inc(CounterFamily family, const dtpString *labelValues, uint labelCount, uint64 value)
+{
+  inc(registerSeries(family, labelValues, labelCount), value);
+}
+
+uint64 Counter::getTotal(CounterFamily family, const dtpString *labelValues, uint labelCount)
+{
+  return getTotal(registerSeries(family, labelValues, labelCount));
+}
+
+void Counter::takeLabelSnapshot(CounterLabelSnapshot &output)
+{
+  uint count = m_series.size();
+  std::vector<uint> slots(count);
+  CounterTotalColn totals;
+
+  for(uint i=0; i != count; i++)
+    slots[i] = m_series.at(i)->value->getSlot();
+  prepareTotals(slots, totals);
+
+  output.m_series.resize(count);
+  for(uint i=0; i != count; i++)
+  {
+    const CounterSeriesMapColn::Entry *entry = m_series.at(i);
+    CounterLabelSnapshot::Series &series = output.m_series[i];
+
+    series.family = read_id(entry->name, 0);
+    series.labelCount = entry->name.size() / SERIES_ID_SIZE - 1;
+    for(uint j=0; j != series.labelCount; j++)
+      series.labels[j] = read_id(entry->name, j + 1);
+    series.value = entry->value->calcTotal(totals[i]);
+  }
+}
+
+void Counter::visitSeries(CounterVisitorIntf *visitor, CompiledFilter *filter)
+{
+  CounterLabelSnapshot snapshot;
+  CounterLabel labels[COUNTER_MAX_LABELS];
+  uint lastFamily = 0;
+  const CounterFamilyMapColn::Entry *family = DTP_NULL;
+  bool matching = false;
+
+  takeLabelSnapshot(snapshot);
+
+  for(uint i=0, epos = snapshot.size(); i != epos; i++)
+  {
+    const CounterLabelSnapshot::Series &series = snapshot.at(i);
+    if ((family == DTP_NULL) || (series.family != lastFamily))
+    {
+      lastFamily = series.family;
+      family = m_families.at(series.family);
+      matching = (filter == DTP_NULL) || filter->isMatching(family->name);
+    }
+
+    if (!matching)
+      continue;
+
+    for(uint j=0; j != series.labelCount; j++)
+    {
+      labels[j].key = &getSymbol(family->value->keys[j]);
+      labels[j].value = &getSymbol(series.labels[j]);
+    }
+    visitor->visitSeries(family->name, labels, series.labelCount, series.value);
+  }
+}
@@ -0,0 +1,214 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CounterShards.cpp
+// Project:     perfLib
+// Purpose:     Per-thread storage of counter values
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include "boost/thread/tss.hpp"
+
+#include "perf/details/CounterShards.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// CounterShard
+// ----------------------------------------------------------------------------
+CounterShard::CounterShard()
+{
+  m_next = DTP_NULL;
+  for(uint i=0; i != COUNTER_SHARD_MAX_CHUNKS; i++)
+    m_chunks[i] = DTP_NULL;
+}
+
+CounterShard::~CounterShard()
+{
+  for(uint i=0; i != COUNTER_SHARD_MAX_CHUNKS; i++)
+    if (m_chunks[i] != DTP_NULL)
+      free_cache_aligned(m_chunks[i]);
+}
+
+CounterShardChunk *CounterShard::allocChunk(uint chunkIdx)
+{
+  CounterShardChunk *res = static_cast<CounterShardChunk *>(alloc_cache_aligned(sizeof(CounterShardChunk)));
+  if (res == DTP_NULL)
+    throw std::bad_alloc();
+  atomic_store_release(&m_chunks[chunkIdx], res);
+  return res;
+}
+
+uint64 CounterShard::get(uint slot) const
+{
+  const CounterShardChunk *chunk = atomic_load_acquire(&m_chunks[slot >> COUNTER_SHARD_CHUNK_BITS]);
+  if (chunk == DTP_NULL)
+    return 0;
+  return atomic_load(&(chunk->values[slot & COUNTER_SHARD_CHUNK_MASK]));
+}
+
+void CounterShard::sumInto(uint slotCount, uint64 *output) const
+{
+  const CounterShardChunk *chunk;
+  uint chunkCount = (slotCount + COUNTER_SHARD_CHUNK_MASK) >> COUNTER_SHARD_CHUNK_BITS;
+  uint base, cnt;
+
+  for(uint c=0; c != chunkCount; c++)
+  {
+    chunk = atomic_load_acquire(&m_chunks[c]);
+    if (chunk == DTP_NULL)
+      continue;
+
+    base = c << COUNTER_SHARD_CHUNK_BITS;
+    cnt = slotCount - base;
+    if (cnt > COUNTER_SHARD_CHUNK_SIZE)
+      cnt = COUNTER_SHARD_CHUNK_SIZE;
+
+    add_vector(output + base, const_cast<const uint64 *>(chunk->values), cnt);
+  }
+}
+
+void CounterShard::addRange(uint slot, const uint64 *values, uint count)
+{
+  uint cnt;
+
+  while(count > 0)
+  {
+    // range can cross chunk boundary
+    cnt = COUNTER_SHARD_CHUNK_SIZE - (slot & COUNTER_SHARD_CHUNK_MASK);
+    if (cnt > count)
+      cnt = count;
+    add_vector(const_cast<uint64 *>(slotPtr(slot)), values, cnt);
+    slot += cnt;
+    values += cnt;
+    count -= cnt;
+  }
+}
+
+void CounterShard::merge(const CounterShard &src)
+{
+  const CounterShardChunk *chunk;
+  uint64 value;
+
+  for(uint c=0; c != COUNTER_SHARD_MAX_CHUNKS; c++)
+  {
+    chunk = atomic_load_acquire(&src.m_chunks[c]);
+    if (chunk == DTP_NULL)
+      continue;
+
+    for(uint i=0; i != COUNTER_SHARD_CHUNK_SIZE; i++)
+    {
+      value = atomic_load(&(chunk->values[i]));
+      if (value != 0)
+        add((c << COUNTER_SHARD_CHUNK_BITS) + i, value);
+    }
+  }
+}
+
+void CounterShard::clear(uint slot)
+{
+  CounterShardChunk *chunk = atomic_load_acquire(&m_chunks[slot >> COUNTER_SHARD_CHUNK_BITS]);
+  if (chunk != DTP_NULL)
+    atomic_store(&(chunk->values[slot & COUNTER_SHARD_CHUNK_MASK]), static_cast<uint64>(0));
+}
+
+// ----------------------------------------------------------------------------
+// CounterShards
+// ----------------------------------------------------------------------------
+PERF_THREAD_LOCAL CounterShard *CounterShards::m_current = DTP_NULL;
+CounterShard *CounterShards::m_active = DTP_NULL;
+CounterShard *CounterShards::m_retired = DTP_NULL;
+
+CounterShard *CounterShards::attach()
+{
+  std::auto_ptr<CounterShard> guard(new CounterShard());
+#pragma omp critical(counter_shards)
+{
+  // owner of thread's shard, calls retire() on thread exit
+  static boost::thread_specific_ptr<CounterShard> owner(&CounterShards::retire);
+
+  if (m_retired == DTP_NULL)
+    m_retired = new CounterShard();
+  owner.reset(guard.get());
+  guard->m_next = m_active;
+  m_active = guard.get();
+}
+  m_current = guard.release();
+  return m_current;
+}
+
+void CounterShards::retire(CounterShard *shard)
+{
+#pragma omp critical(counter_shards)
+{
+  CounterShard **prev = &m_active;
+  while((*prev != DTP_NULL) && (*prev != shard))
+    prev = &((*prev)->m_next);
+  if (*prev != DTP_NULL)
+    *prev = shard->m_next;
+
+  m_retired->merge(*shard);
+}
+  if (m_current == shard)
+    m_current = DTP_NULL;
+  delete shard;
+}
+
+uint64 CounterShards::getTotal(uint slot)
+{
+  uint64 res = 0;
+#pragma omp critical(counter_shards)
+{
+  for(CounterShard *shard = m_active; shard != DTP_NULL; shard = shard->m_next)
+    res += shard->get(slot);
+  if (m_retired != DTP_NULL)
+    res += m_retired->get(slot);
+}
+  return res;
+}
+
+void CounterShards::getTotals(uint slotCount, uint64 *output)
+{
+  for(uint i=0; i != slotCount; i++)
+    output[i] = 0;
+
+#pragma omp critical(counter_shards)
+{
+  for(CounterShard *shard = m_active; shard != DTP_NULL; shard = shard->m_next)
+    shard->sumInto(slotCount, output);
+  if (m_retired != DTP_NULL)
+    m_retired->sumInto(slotCount, output);
+}
+}
+
+void CounterShards::getTotals(const uint *slots, uint slotCount, uint64 *output)
+{
+  for(uint i=0; i != slotCount; i++)
+    output[i] = 0;
+
+#pragma omp critical(counter_shards)
+{
+  for(CounterShard *shard = m_active; shard != DTP_NULL; shard = shard->m_next)
+    for(uint i=0; i != slotCount; i++)
+      output[i] += shard->get(slots[i]);
+  if (m_retired != DTP_NULL)
+    for(uint i=0; i != slotCount; i++)
+      output[i] += m_retired->get(slots[i]);
+}
+}
+
+void CounterShards::clearSlot(uint slot)
+{
+#pragma omp critical(counter_shards)
+{
+  for(CounterShard *shard = m_active; shard != DTP_NULL; shard = shard->m_next)
+    shard->clear(slot);
+  if (m_retired != DTP_NULL)
+    m_retired->clear(slot);
+}
+}
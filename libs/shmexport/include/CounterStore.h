@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CounterStore.h
+// Project:     perfLib
+// Purpose:     Keeps counter & timer totals in memory-mapped file between runs
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFCOUNTERSTORE_H__
+#define _PERFCOUNTERSTORE_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file CounterStore.h
+///
+/// Persistent variant of ShmExporter: values are copied to a file mapped
+/// with MAP_SHARED (on Win32 file mapping). Values written to the mapping 
+/// are kept by the OS even if the process crashes, without msync (only 
+/// power loss / OS crash can lose data not written back yet).
+///
+/// Increments are not affected - store runs its own thread which copies
+/// values with save() every <saveIntervalMs> (see open), and close() saves 
+/// them once more, so no explicit flushing is needed. Only values changed 
+/// during the last interval before a crash are lost; save() can be called
+/// at any time to shorten this window (e.g. after important updates).
+///
+/// On open totals saved by previous run are added to global counters &
+/// timers, entries of such items are marked with sefRestored flag.
+/// Restore is limited like inc(): names above capacity of counters or 
+/// timers are added to their overflow items.
+/// The file is rebuilt in a temporary file and renamed over the old one,
+/// so a crash during open never loses saved totals.
+///
+/// Entries of removed items are freed by the next save(), so removed names
+/// are not restored by next run - unless the process crashed before that
+/// save().
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include "perf/details/ptypes.h"
+#include "perf/details/FlatNameMap.h"
+#include "perf/ShmExporter.h"
+
+namespace boost {
+class thread;
+};
+
+namespace perf {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// Default interval of automatic save
+const uint COUNTER_STORE_SAVE_INTERVAL_MS = 1000;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+class CounterStore: public ShmExporter {
+public:
+  CounterStore();
+  virtual ~CounterStore();
+  /// Maps file (creates it if needed), restores totals saved there by previous run
+  /// and starts thread which saves values every <saveIntervalMs> (0 = saved only by save() & close())
+  /// \return <false> if file cannot be created or mapped
+  bool open(const dtpString &path, uint capacity = SHM_DEF_CAPACITY, 
+    uint saveIntervalMs = COUNTER_STORE_SAVE_INTERVAL_MS);
+  /// Copies current values of counters & timers to file, can be called by any thread
+  void save();
+  /// Stops saving thread, saves values and unmaps file
+  virtual void close();
+  /// Returns number of items restored from previous run
+  uint getRestoredCount() const { return m_restored.size(); }
+  /// \return <true> if counter (or timer) total includes value from previous run
+  bool isRestored(const dtpString &name, uint kind = Details::sekCounter);
+  /// Returns number of runs which have written to file, including current one
+  uint getRunCount();
+protected:
+  /// Adds saved values to global items, returns number of runs stored in file
+  uint restore(const dtpString &path);
+  /// Sets sefRestored flag on entries of restored items
+  void markRestored();
+  /// Body of saving thread, runs until it is interrupted by close()
+  void autoSave(uint intervalMs);
+  static dtpString restoredKey(const dtpString &name, uint kind);
+private:
+  // restored items, key = kind + name
+  Details::FlatNameMap<bool> m_restored;
+  boost::thread *m_saver;
+};
+
+}; // namespace perf
+
+#endif // _PERFCOUNTERSTORE_H__
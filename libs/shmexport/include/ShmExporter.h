@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ShmExporter.h
+// Project:     perfLib
+// Purpose:     Publishes counter & timer values in shared memory segment
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFSHMEXPORTER_H__
+#define _PERFSHMEXPORTER_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file ShmExporter.h
+///
+/// Copies values of all global counters & timers into a named shared-memory 
+/// segment (POSIX shm_open + mmap, on Win32 named file mapping), which can 
+/// be read by another process with ShmReader, without any cooperation of producer.
+/// publish() only writes to mapped memory - no system calls, no serialization.
+/// Call it periodically from a single thread.
+///
+/// Entries of removed counters & timers are freed by the next publish() and
+/// reused for new items, so segment holds at most <capacity> live items 
+/// at a time. Items above capacity are not exported until entries are freed,
+/// each publish() stores their current number in header (dropped, see getDroppedCount).
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+
+#include "perf/details/ptypes.h"
+#include "perf/details/ShmLayout.h"
+#include "perf/details/FlatNameMap.h"
+#include "perf/Counter.h"
+#include "perf/Timer.h"
+
+namespace perf {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const uint SHM_DEF_CAPACITY = 4096;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+class ShmExporter {
+  friend class ShmTimerWriter;
+public:
+  ShmExporter();
+  virtual ~ShmExporter();
+  /// Creates (or replaces) segment, name should start with '/', e.g. "/myapp.perf"
+  /// \return <false> if segment cannot be created
+  bool open(const dtpString &segmentName, uint capacity = SHM_DEF_CAPACITY);
+  /// Unmaps and removes segment
+  virtual void close();
+  bool isOpen() const { return (m_header != DTP_NULL); }
+  /// Copies current values of counters & timers to segment
+  void publish();
+  /// Returns number of live items not exported by last publish() because segment was full
+  uint64 getDroppedCount() const;
+protected:
+  void publishCounters();
+  void publishTimers();
+  void publishTimer(const dtpString &name, cpu_ticks value);
+  /// Frees entries of timers not visited by current publish
+  void freeTimerEntries();
+  /// Rebuilds name map of timers when it contains too many names of removed timers
+  void compactTimerEntries();
+  /// Initializes header of mapped block of <size> bytes, exporter unmaps it on close()
+  void init(void *mem, size_t size, uint capacity);
+  /// Replaces mapped block (if any) by another view of the same content, old block is unmapped.
+  /// Unlike init(), header & assignment of entries to items are kept.
+  void remap(void *mem, size_t size, void *mapping);
+  /// Sets handle of mapping object (Win32), closed by close()
+  void setMapping(void *mapping) { m_mapping = mapping; }
+  /// Unmaps block and closes mapping handle (Win32)
+  static void unmap(void *mem, size_t size, void *mapping);
+  Details::ShmHeader *getHeader() { return m_header; }
+  Details::ShmEntry *getEntries() { return m_entries; }
+  /// Returns entry for a new item or NULL if segment is full
+  Details::ShmEntry *addEntry(const dtpString &name, uint kind);
+  /// Marks entry as free, it can be reused by addEntry
+  void freeEntry(Details::ShmEntry *entry);
+private:
+  // no copy
+  ShmExporter(const ShmExporter &);
+  ShmExporter &operator=(const ShmExporter &);
+private:
+  dtpString m_segmentName;
+  Details::ShmHeader *m_header;
+  Details::ShmEntry *m_entries;
+  size_t m_size;
+  // handle of mapping object, Win32 only
+  void *m_mapping;
+  CounterSnapshot m_snapshot;
+  // entry number + 1 for each counter index, zero if not assigned
+  std::vector<uint> m_counterEntries;
+  // generation of counter which owns entry, see CounterSnapshot::getGeneration
+  std::vector<uint> m_counterGenerations;
+  // entry number + 1 for each timer name, zero if entry was freed
+  Details::FlatNameMap<uint> m_timerEntries;
+  uint m_timerCount;
+  // for each entry: full name of timer & number of last publish which has visited it
+  std::vector<dtpString> m_timerNames;
+  std::vector<uint64> m_timerRounds;
+  uint64 m_round;
+  // items not exported by current publish
+  uint64 m_dropped;
+  // numbers of free entries
+  std::vector<uint> m_freeEntries;
+};
+
+}; // namespace perf
+
+#endif // _PERFSHMEXPORTER_H__
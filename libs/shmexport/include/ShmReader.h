@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ShmReader.h
+// Project:     perfLib
+// Purpose:     Reads values published by ShmExporter in another process
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFSHMREADER_H__
+#define _PERFSHMREADER_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file ShmReader.h
+///
+/// Attaches to segment created by ShmExporter (read-only) and copies
+/// a consistent set of values from it. Does not depend on counter or timer
+/// libraries, so it can be used in external tools.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <vector>
+
+#include "perf/details/ptypes.h"
+#include "perf/details/ShmLayout.h"
+
+namespace perf {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// Number of attempts to get consistent copy before read() gives up
+const uint SHM_READ_RETRY_LIMIT = 1000;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+struct ShmItem {
+  dtpString name;
+  /// see Details::ShmEntryKind
+  uint kind;
+  /// see Details::ShmEntryFlag
+  uint flags;
+  uint64 value;
+};
+
+typedef std::vector<ShmItem> ShmItemColn;
+
+class ShmReader {
+public:
+  ShmReader();
+  virtual ~ShmReader();
+  /// \return <false> if segment does not exist or has unsupported layout
+  bool open(const dtpString &segmentName);
+  /// Opens file written by CounterStore
+  /// \return <false> if file does not exist or has unsupported layout
+  bool openFile(const dtpString &path);
+  void close();
+  bool isOpen() const { return (m_header != DTP_NULL); }
+  /// Copies all published items to output (free entries are skipped)
+  /// \return <false> if consistent copy could not be taken (writer too busy)
+  bool read(ShmItemColn &output);
+  /// Returns time of last update in producer's os_uptime_ms
+  uint64 getUpdateTimeMs() const;
+  uint getProducerPid() const;
+  /// Returns number of runs which have written to segment / file
+  uint getRunCount() const;
+protected:
+#if defined(_WIN32)
+  /// Maps view of mapping object (size 0 = size of view), keeps handle until close()
+  bool attach(void *mapping, size_t size);
+#else
+  /// Maps segment or file opened for reading, closes descriptor
+  bool attach(int fd);
+#endif
+  /// Checks header of mapped block, block is unmapped if layout is not supported
+  bool attachBlock(void *mem, size_t size);
+private:
+  // no copy
+  ShmReader(const ShmReader &);
+  ShmReader &operator=(const ShmReader &);
+private:
+  const Details::ShmHeader *m_header;
+  const Details::ShmEntry *m_entries;
+  size_t m_size;
+  // handle of mapping object, Win32 only
+  void *m_mapping;
+};
+
+}; // namespace perf
+
+#endif // _PERFSHMREADER_H__
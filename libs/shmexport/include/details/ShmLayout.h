@@ -0,0 +1,96 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ShmLayout.h
+// Project:     perfLib
+// Purpose:     Layout of shared-memory metrics segment
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFSHMLAYOUT_H__
+#define _PERFSHMLAYOUT_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file ShmLayout.h
+///
+/// Segment = header + array of fixed-size entries.
+/// Writer increments sequence before (odd) and after (even) each update,
+/// reader copies data and repeats when sequence was odd or has changed.
+/// Entries of removed items are freed (kind = sekFree, empty name) and
+/// reused for new items - name of an entry can change only while sequence is odd.
+/// Readers must check magic & version before using any other field.
+/// The same layout is used by file-backed CounterStore.
+///
+/// Version history:
+/// 1 - initial layout
+/// 2 - header.runCount & entry.flags (previously reserved)
+/// 3 - free entries (sekFree), entries are reused; version 2 is still readable
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include "perf/details/ptypes.h"
+
+namespace perf {
+namespace Details {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+/// "PRFM"
+const uint SHM_MAGIC = 0x4d465250;
+const uint SHM_VERSION = 3;
+/// Oldest version readable with current layout
+const uint SHM_MIN_VERSION = 2;
+/// Max name length including terminating zero, longer names are truncated
+const uint SHM_NAME_SIZE = 112;
+
+enum ShmEntryKind {
+  /// entry of removed item, can be reused
+  sekFree = 0,
+  sekCounter = 1,
+  sekTimer = 2
+};
+
+enum ShmEntryFlag {
+  /// value includes total restored from previous run (see CounterStore)
+  sefRestored = 1
+};
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+struct ShmHeader {
+  uint magic;
+  uint version;
+  uint headerSize;
+  uint entrySize;
+  /// Max number of entries
+  uint capacity;
+  /// Number of published entries, including free ones
+  volatile uint count;
+  /// Seqlock counter, odd while writer updates segment
+  volatile uint64 sequence;
+  /// Time of last update (os_uptime_ms of producer)
+  volatile uint64 updateTimeMs;
+  /// Number of live items not exported by last update because segment is full
+  volatile uint64 dropped;
+  uint pid;
+  /// Number of runs which have written to the file (CounterStore), 1 for shm segment
+  uint runCount;
+};
+
+struct ShmEntry {
+  char name[SHM_NAME_SIZE];
+  uint kind;
+  /// see ShmEntryFlag
+  volatile uint flags;
+  volatile uint64 value;
+};
+
+}; // namespace Details
+}; // namespace perf
+
+#endif // _PERFSHMLAYOUT_H__
@@ -0,0 +1,239 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        CounterStore.cpp
+// Project:     perfLib
+// Purpose:     Keeps counter & timer totals in memory-mapped file between runs
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "boost/thread/thread.hpp"
+
+#include "perf/CounterStore.h"
+#include "perf/ShmReader.h"
+#include "perf/Counter.h"
+#include "perf/Timer.h"
+#include "perf/details/atomic_ops.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// CounterStore
+// ----------------------------------------------------------------------------
+CounterStore::CounterStore()
+{
+  m_saver = DTP_NULL;
+}
+
+CounterStore::~CounterStore()
+{
+  close();
+}
+
+bool CounterStore::open(const dtpString &path, uint capacity, uint saveIntervalMs)
+{
+  close();
+  m_restored.clear();
+
+  uint runCount = restore(path);
+
+  // new content is prepared aside, old file stays valid until rename
+  dtpString tempPath = path + ".tmp";
+  size_t size = sizeof(ShmHeader) + static_cast<size_t>(capacity) * sizeof(ShmEntry);
+
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(tempPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    DTP_NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, DTP_NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  // file is extended to size of mapping
+  HANDLE mapping = CreateFileMappingA(file, DTP_NULL, PAGE_READWRITE, 
+    static_cast<DWORD>(static_cast<uint64>(size) >> 32), static_cast<DWORD>(size), DTP_NULL);
+  CloseHandle(file);
+  void *mem = (mapping != DTP_NULL) ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : DTP_NULL;
+  if (mem == DTP_NULL)
+  {
+    if (mapping != DTP_NULL)
+      CloseHandle(mapping);
+    DeleteFileA(tempPath.c_str());
+    return false;
+  }
+  setMapping(mapping);
+#else
+  int fd = ::open(tempPath.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+
+  void *mem = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    mem = mmap(DTP_NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (mem == MAP_FAILED)
+  {
+    unlink(tempPath.c_str());
+    return false;
+  }
+#endif
+
+  init(mem, size, capacity);
+  getHeader()->runCount = runCount + 1;
+  publish();
+  markRestored();
+
+#if defined(_WIN32)
+  // mapped file cannot be renamed over an existing one - content is written 
+  // back, file is renamed and mapped again
+  FlushViewOfFile(mem, 0);
+  ShmExporter::close();
+  if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+  {
+    DeleteFileA(tempPath.c_str());
+    return false;
+  }
+
+  file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    DTP_NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, DTP_NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  mapping = CreateFileMappingA(file, DTP_NULL, PAGE_READWRITE, 0, 0, DTP_NULL);
+  CloseHandle(file);
+  mem = (mapping != DTP_NULL) ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : DTP_NULL;
+  if (mem == DTP_NULL)
+  {
+    if (mapping != DTP_NULL)
+      CloseHandle(mapping);
+    return false;
+  }
+  // header & entries are already written, assignment of entries to items is kept
+  remap(mem, size, mapping);
+#else
+  // mapping stays valid after rename, it refers to the same file
+  if (rename(tempPath.c_str(), path.c_str()) != 0)
+  {
+    close();
+    unlink(tempPath.c_str());
+    return false;
+  }
+#endif
+
+  if (saveIntervalMs > 0)
+    m_saver = new boost::thread(&CounterStore::autoSave, this, saveIntervalMs);
+  return true;
+}
+
+void CounterStore::save()
+{
+  // called by owner and by saver thread
+#pragma omp critical(perf_counter_store)
+{
+  publish();
+}
+}
+
+void CounterStore::close()
+{
+  if (m_saver != DTP_NULL)
+  {
+    m_saver->interrupt();
+    m_saver->join();
+    delete m_saver;
+    m_saver = DTP_NULL;
+  }
+  // values changed since last periodic save are kept on normal exit
+  if (isOpen())
+    save();
+  ShmExporter::close();
+}
+
+void CounterStore::autoSave(uint intervalMs)
+{
+  try {
+    for(;;)
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(intervalMs));
+      save();
+    }
+  }
+  catch(boost::thread_interrupted &) {
+    // store is closed
+  }
+}
+
+uint CounterStore::restore(const dtpString &path)
+{
+  ShmReader reader;
+  ShmItemColn items;
+
+  if (!reader.openFile(path) || !reader.read(items))
+    return 0;
+
+  for(uint i=0, epos = items.size(); i != epos; i++)
+  {
+    const ShmItem &item = items[i];
+    if ((item.value == 0) || item.name.empty())
+      continue;
+
+    switch(item.kind) {
+      case sekCounter:
+        Counter::restore(item.name, item.value);
+        break;
+      case sekTimer:
+        Timer::restore(item.name, item.value);
+        break;
+      default:
+        continue;
+    }
+    m_restored.get(restoredKey(item.name, item.kind)) = true;
+  }
+
+  return reader.getRunCount();
+}
+
+void CounterStore::markRestored()
+{
+  ShmHeader *header = getHeader();
+  ShmEntry *entries = getEntries();
+  dtpString name;
+
+  for(uint i=0, epos = atomic_load(&header->count); i != epos; i++)
+  {
+    name.assign(entries[i].name, strnlen(entries[i].name, SHM_NAME_SIZE));
+    if (isRestored(name, entries[i].kind))
+      atomic_store(&entries[i].flags, static_cast<uint>(sefRestored));
+  }
+}
+
+bool CounterStore::isRestored(const dtpString &name, uint kind)
+{
+  return (m_restored.find(restoredKey(name, kind)) != DTP_NULL);
+}
+
+uint CounterStore::getRunCount()
+{
+  return isOpen() ? getHeader()->runCount : 0;
+}
+
+dtpString CounterStore::restoredKey(const dtpString &name, uint kind)
+{
+  char prefix[16];
+  sprintf(prefix, "%u:", kind);
+  return prefix + name;
+}
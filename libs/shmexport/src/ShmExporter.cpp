@@ -0,0 +1,358 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ShmExporter.cpp
+// Project:     perfLib
+// Purpose:     Publishes counter & timer values in shared memory segment
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "perf/ShmExporter.h"
+#include "perf/Timer.h"
+#include "perf/time_utils.h"
+#include "perf/details/atomic_ops.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// Local definitions
+// ----------------------------------------------------------------------------
+namespace perf {
+
+// Writes visited timer totals to segment
+class ShmTimerWriter: public TimerVisitorIntf {
+public:
+  ShmTimerWriter(ShmExporter &exporter): m_exporter(exporter) {}
+  virtual ~ShmTimerWriter() {}
+  virtual void visit(const dtpString &timerName, cpu_ticks value)
+  {
+    m_exporter.publishTimer(timerName, value);
+  }
+private:
+  ShmExporter &m_exporter;
+};
+
+}; // namespace perf
+
+// ----------------------------------------------------------------------------
+// ShmExporter
+// ----------------------------------------------------------------------------
+ShmExporter::ShmExporter()
+{
+  m_header = DTP_NULL;
+  m_entries = DTP_NULL;
+  m_size = 0;
+  m_mapping = DTP_NULL;
+  m_timerCount = 0;
+  m_round = 0;
+  m_dropped = 0;
+}
+
+ShmExporter::~ShmExporter()
+{
+  close();
+}
+
+bool ShmExporter::open(const dtpString &segmentName, uint capacity)
+{
+  close();
+
+  size_t size = sizeof(ShmHeader) + static_cast<size_t>(capacity) * sizeof(ShmEntry);
+
+#if defined(_WIN32)
+  // mapping backed by paging file, it exists while any process has a handle to it
+  HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, DTP_NULL, PAGE_READWRITE, 
+    static_cast<DWORD>(static_cast<uint64>(size) >> 32), static_cast<DWORD>(size), segmentName.c_str());
+  if (mapping == DTP_NULL)
+    return false;
+  // segment of other producer (or of a reader still attached to previous run) cannot be replaced
+  if (GetLastError() == ERROR_ALREADY_EXISTS)
+  {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  void *mem = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (mem == DTP_NULL)
+  {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  init(mem, size, capacity);
+  m_mapping = mapping;
+  m_segmentName = segmentName;
+  return true;
+#else
+  // readers attached to previous segment keep it until they detach
+  shm_unlink(segmentName.c_str());
+  int fd = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+
+  void *mem = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    mem = mmap(DTP_NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (mem == MAP_FAILED)
+  {
+    shm_unlink(segmentName.c_str());
+    return false;
+  }
+
+  init(mem, size, capacity);
+  m_segmentName = segmentName;
+  return true;
+#endif
+}
+
+void ShmExporter::init(void *mem, size_t size, uint capacity)
+{
+  m_segmentName.clear();
+  m_size = size;
+  m_header = static_cast<ShmHeader *>(mem);
+  m_entries = reinterpret_cast<ShmEntry *>(static_cast<char *>(mem) + sizeof(ShmHeader));
+  m_counterEntries.clear();
+  m_counterGenerations.clear();
+  m_timerEntries.clear();
+  m_timerCount = 0;
+  m_timerNames.assign(capacity, dtpString());
+  m_timerRounds.assign(capacity, 0);
+  m_round = 0;
+  m_freeEntries.clear();
+
+  m_header->version = SHM_VERSION;
+  m_header->headerSize = sizeof(ShmHeader);
+  m_header->entrySize = sizeof(ShmEntry);
+  m_header->capacity = capacity;
+  m_header->count = 0;
+  m_header->sequence = 0;
+  m_header->updateTimeMs = 0;
+  m_header->dropped = 0;
+#if !defined(_WIN32)
+  m_header->pid = static_cast<uint>(getpid());
+#endif
+#if defined(_WIN32)
+  m_header->pid = static_cast<uint>(GetCurrentProcessId());
+#endif
+  m_header->runCount = 1;
+  // header is valid when magic is visible
+  atomic_store_release(&m_header->magic, SHM_MAGIC);
+}
+
+void ShmExporter::close()
+{
+  if (m_header == DTP_NULL)
+    return;
+
+  unmap(m_header, m_size, m_mapping);
+#if !defined(_WIN32)
+  // mapped files are kept
+  if (!m_segmentName.empty())
+    shm_unlink(m_segmentName.c_str());
+#endif
+  m_header = DTP_NULL;
+  m_entries = DTP_NULL;
+  m_size = 0;
+  m_mapping = DTP_NULL;
+  m_segmentName.clear();
+}
+
+void ShmExporter::remap(void *mem, size_t size, void *mapping)
+{
+  if (m_header != DTP_NULL)
+    unmap(m_header, m_size, m_mapping);
+  m_size = size;
+  m_mapping = mapping;
+  m_header = static_cast<ShmHeader *>(mem);
+  m_entries = reinterpret_cast<ShmEntry *>(static_cast<char *>(mem) + sizeof(ShmHeader));
+}
+
+void ShmExporter::unmap(void *mem, size_t size, void *mapping)
+{
+#if defined(_WIN32)
+  UnmapViewOfFile(mem);
+  if (mapping != DTP_NULL)
+    CloseHandle(static_cast<HANDLE>(mapping));
+#else
+  munmap(mem, size);
+#endif
+}
+
+void ShmExporter::publish()
+{
+  if (!isOpen())
+    return;
+
+  Counter::takeSnapshot(m_snapshot);
+
+  uint64 seq = atomic_load(&m_header->sequence);
+  atomic_store(&m_header->sequence, seq + 1);
+  atomic_thread_fence();
+
+  m_dropped = 0;
+  publishCounters();
+  publishTimers();
+  atomic_store(&m_header->dropped, m_dropped);
+  atomic_store(&m_header->updateTimeMs, os_uptime_ms());
+
+  atomic_store_release(&m_header->sequence, seq + 2);
+}
+
+uint64 ShmExporter::getDroppedCount() const
+{
+  return isOpen() ? atomic_load(&m_header->dropped) : 0;
+}
+
+void ShmExporter::publishCounters()
+{
+  uint count = m_snapshot.size();
+  bool full = false;
+  m_counterEntries.resize(count, 0);
+  m_counterGenerations.resize(count, COUNTER_REMOVED_GENERATION);
+
+  for(uint i=0; i != count; i++)
+  {
+    // entry of removed counter (or of previous counter using this index) is reused
+    if ((m_counterEntries[i] != 0) && (m_counterGenerations[i] != m_snapshot.getGeneration(i)))
+    {
+      freeEntry(&m_entries[m_counterEntries[i] - 1]);
+      m_counterEntries[i] = 0;
+    }
+
+    if (m_snapshot.isRemoved(i))
+      continue;
+
+    if (m_counterEntries[i] == 0)
+    {
+      // names are not resolved once segment is full, rest of items is only counted
+      if (full)
+      {
+        m_dropped++;
+        continue;
+      }
+      dtpString name = m_snapshot.getName(i);
+      if (name.empty())
+        continue;
+      ShmEntry *entry = addEntry(name, sekCounter);
+      if (entry == DTP_NULL)
+      {
+        full = true;
+        m_dropped++;
+        continue;
+      }
+      m_counterEntries[i] = (entry - m_entries) + 1;
+      m_counterGenerations[i] = m_snapshot.getGeneration(i);
+    }
+
+    atomic_store(&(m_entries[m_counterEntries[i] - 1].value), m_snapshot.getValue(i));
+  }
+}
+
+void ShmExporter::publishTimers()
+{
+  ShmTimerWriter writer(*this);
+  m_round++;
+  Timer::visitAll(&writer);
+  freeTimerEntries();
+  compactTimerEntries();
+}
+
+void ShmExporter::publishTimer(const dtpString &name, cpu_ticks value)
+{
+  uint &entryNo = m_timerEntries.get(name);
+  if (entryNo == 0)
+  {
+    ShmEntry *entry = addEntry(name, sekTimer);
+    if (entry == DTP_NULL)
+    {
+      m_dropped++;
+      return;
+    }
+    entryNo = (entry - m_entries) + 1;
+    m_timerNames[entryNo - 1] = name;
+    m_timerCount++;
+  }
+  m_timerRounds[entryNo - 1] = m_round;
+  atomic_store(&(m_entries[entryNo - 1].value), static_cast<uint64>(value));
+}
+
+void ShmExporter::freeTimerEntries()
+{
+  for(uint i=0, epos = m_header->count; i != epos; i++)
+  {
+    if ((m_entries[i].kind != sekTimer) || (m_timerRounds[i] == m_round))
+      continue;
+    // timer removed
+    *m_timerEntries.find(m_timerNames[i]) = 0;
+    m_timerNames[i].clear();
+    m_timerCount--;
+    freeEntry(&m_entries[i]);
+  }
+}
+
+void ShmExporter::compactTimerEntries()
+{
+  if (m_timerEntries.size() <= 2 * m_timerCount + SHM_DEF_CAPACITY)
+    return;
+
+  m_timerEntries.clear();
+  for(uint i=0, epos = m_header->count; i != epos; i++)
+    if (m_entries[i].kind == sekTimer)
+      m_timerEntries.get(m_timerNames[i]) = i + 1;
+}
+
+ShmEntry *ShmExporter::addEntry(const dtpString &name, uint kind)
+{
+  ShmEntry *res;
+  uint count = m_header->count;
+
+  if (!m_freeEntries.empty())
+  {
+    res = &m_entries[m_freeEntries.back()];
+    m_freeEntries.pop_back();
+  } else if (count < m_header->capacity) {
+    res = &m_entries[count];
+  } else {
+    return DTP_NULL;
+  }
+
+  size_t len = name.size();
+  if (len >= SHM_NAME_SIZE)
+    len = SHM_NAME_SIZE - 1;
+  memcpy(res->name, name.c_str(), len);
+  res->name[len] = '\0';
+  res->kind = kind;
+  res->flags = 0;
+  res->value = 0;
+
+  if (res == &m_entries[count])
+    atomic_store_release(&m_header->count, count + 1);
+  return res;
+}
+
+void ShmExporter::freeEntry(ShmEntry *entry)
+{
+  entry->name[0] = '\0';
+  entry->kind = sekFree;
+  atomic_store(&entry->flags, 0U);
+  atomic_store(&entry->value, static_cast<uint64>(0));
+  m_freeEntries.push_back(entry - m_entries);
+}
@@ -0,0 +1,229 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ShmReader.cpp
+// Project:     perfLib
+// Purpose:     Reads values published by ShmExporter in another process
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+#include "perf/ShmReader.h"
+#include "perf/details/atomic_ops.h"
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+using namespace perf::Details;
+
+// ----------------------------------------------------------------------------
+// ShmReader
+// ----------------------------------------------------------------------------
+ShmReader::ShmReader()
+{
+  m_header = DTP_NULL;
+  m_entries = DTP_NULL;
+  m_size = 0;
+  m_mapping = DTP_NULL;
+}
+
+ShmReader::~ShmReader()
+{
+  close();
+}
+
+bool ShmReader::open(const dtpString &segmentName)
+{
+  close();
+#if defined(_WIN32)
+  HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segmentName.c_str());
+  if (mapping == DTP_NULL)
+    return false;
+  return attach(mapping, 0);
+#else
+  int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  return attach(fd);
+#endif
+}
+
+bool ShmReader::openFile(const dtpString &path)
+{
+  close();
+#if defined(_WIN32)
+  // writer keeps file open, it can be replaced by next run of producer
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    DTP_NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, DTP_NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  HANDLE mapping = DTP_NULL;
+  if (GetFileSizeEx(file, &fileSize) && (static_cast<uint64>(fileSize.QuadPart) >= sizeof(ShmHeader)))
+    mapping = CreateFileMappingA(file, DTP_NULL, PAGE_READONLY, 0, 0, DTP_NULL);
+  // mapping keeps file open
+  CloseHandle(file);
+  if (mapping == DTP_NULL)
+    return false;
+  return attach(mapping, static_cast<size_t>(fileSize.QuadPart));
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  return attach(fd);
+#endif
+}
+
+#if defined(_WIN32)
+bool ShmReader::attach(void *mapping, size_t size)
+{
+  void *mem = MapViewOfFile(static_cast<HANDLE>(mapping), FILE_MAP_READ, 0, 0, 0);
+  if (mem == DTP_NULL)
+  {
+    CloseHandle(static_cast<HANDLE>(mapping));
+    return false;
+  }
+
+  if (size == 0)
+  {
+    // size of segment is not known, use size of view
+    MEMORY_BASIC_INFORMATION info;
+    if (VirtualQuery(mem, &info, sizeof(info)) != 0)
+      size = info.RegionSize;
+  }
+
+  m_mapping = mapping;
+  return attachBlock(mem, size);
+}
+#else
+bool ShmReader::attach(int fd)
+{
+  struct stat info;
+  void *mem = MAP_FAILED;
+  if ((fstat(fd, &info) == 0) && (static_cast<size_t>(info.st_size) >= sizeof(ShmHeader)))
+    mem = mmap(DTP_NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (mem == MAP_FAILED)
+    return false;
+  return attachBlock(mem, info.st_size);
+}
+#endif
+
+bool ShmReader::attachBlock(void *mem, size_t size)
+{
+  const ShmHeader *header = static_cast<const ShmHeader *>(mem);
+
+  if ((size < sizeof(ShmHeader)) ||
+      (atomic_load_acquire(&header->magic) != SHM_MAGIC) || 
+      (header->version < SHM_MIN_VERSION) || (header->version > SHM_VERSION) ||
+      (header->headerSize != sizeof(ShmHeader)) ||
+      (header->entrySize != sizeof(ShmEntry)) ||
+      (sizeof(ShmHeader) + static_cast<size_t>(header->capacity) * sizeof(ShmEntry) > size))
+  {
+    m_header = header;
+    m_size = size;
+    close();
+    return false;
+  }
+
+  m_header = header;
+  m_entries = reinterpret_cast<const ShmEntry *>(static_cast<const char *>(mem) + sizeof(ShmHeader));
+  m_size = size;
+  return true;
+}
+
+void ShmReader::close()
+{
+#if defined(_WIN32)
+  if (m_header != DTP_NULL)
+    UnmapViewOfFile(m_header);
+  if (m_mapping != DTP_NULL)
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+#else
+  if (m_header != DTP_NULL)
+    munmap(const_cast<ShmHeader *>(m_header), m_size);
+#endif
+  m_header = DTP_NULL;
+  m_entries = DTP_NULL;
+  m_size = 0;
+  m_mapping = DTP_NULL;
+}
+
+bool ShmReader::read(ShmItemColn &output)
+{
+  if (!isOpen())
+    return false;
+
+  uint64 seqBefore, seqAfter;
+  uint count;
+
+  for(uint attempt=0; attempt != SHM_READ_RETRY_LIMIT; attempt++)
+  {
+    seqBefore = atomic_load_acquire(&m_header->sequence);
+    if (seqBefore & 1)
+    {
+#if defined(_WIN32)
+      SwitchToThread();
+#else
+      sched_yield();
+#endif
+      continue;
+    }
+
+    count = atomic_load_acquire(&m_header->count);
+    if (count > m_header->capacity)
+      count = m_header->capacity;
+
+    output.resize(count);
+    uint used = 0;
+    for(uint i=0; i != count; i++)
+    {
+      const ShmEntry &entry = m_entries[i];
+      if (entry.kind == sekFree)
+        continue;
+      ShmItem &item = output[used++];
+      item.name.assign(entry.name, strnlen(entry.name, SHM_NAME_SIZE));
+      item.kind = entry.kind;
+      item.flags = atomic_load(&entry.flags);
+      item.value = atomic_load(&entry.value);
+    }
+    output.resize(used);
+
+    atomic_thread_fence();
+    seqAfter = atomic_load(&m_header->sequence);
+    if (seqAfter == seqBefore)
+      return true;
+  }
+
+  return false;
+}
+
+uint64 ShmReader::getUpdateTimeMs() const
+{
+  return isOpen() ? atomic_load(&m_header->updateTimeMs) : 0;
+}
+
+uint ShmReader::getProducerPid() const
+{
+  return isOpen() ? m_header->pid : 0;
+}
+
+uint ShmReader::getRunCount() const
+{
+  return isOpen() ? m_header->runCount : 0;
+}
@@ -0,0 +1,83 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        perfshm.cpp
+// Project:     perfLib
+// Purpose:     Prints values published by ShmExporter
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+// Usage: perfshm [-f] <segment-name> [interval-ms]
+// Without interval values are printed once.
+// With -f name is a path of file written by CounterStore.
+// Values restored from previous run are marked with '*'.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "perf/ShmReader.h"
+
+using namespace perf;
+
+static const char *kind_name(uint kind)
+{
+  switch(kind) {
+    case Details::sekCounter: return "counter";
+    case Details::sekTimer: return "timer";
+    default: return "unknown";
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  bool isFile = (argc > 1) && (strcmp(argv[1], "-f") == 0);
+  int argBase = isFile ? 2 : 1;
+
+  if (argc <= argBase)
+  {
+    fprintf(stderr, "Usage: %s [-f] <segment-name> [interval-ms]\n", argv[0]);
+    return 2;
+  }
+
+  ShmReader reader;
+  if (!(isFile ? reader.openFile(argv[argBase]) : reader.open(argv[argBase])))
+  {
+    fprintf(stderr, "Cannot open segment: %s\n", argv[argBase]);
+    return 1;
+  }
+
+  uint intervalMs = (argc > argBase + 1) ? static_cast<uint>(atoi(argv[argBase + 1])) : 0;
+  ShmItemColn items;
+
+  do {
+    if (!reader.read(items))
+    {
+      fprintf(stderr, "Segment is busy, no consistent copy\n");
+      return 1;
+    }
+
+    printf("# pid %u, run %u, updated at %llu ms\n", reader.getProducerPid(), reader.getRunCount(),
+      static_cast<unsigned long long>(reader.getUpdateTimeMs()));
+    for(uint i=0, epos = items.size(); i != epos; i++)
+      printf("%s\t%s\t%llu%s\n", items[i].name.c_str(), kind_name(items[i].kind), 
+        static_cast<unsigned long long>(items[i].value), 
+        ((items[i].flags & Details::sefRestored) != 0) ? "\t*" : "");
+    fflush(stdout);
+
+    if (intervalMs > 0)
+#if defined(_WIN32)
+      Sleep(intervalMs);
+#else
+      usleep(intervalMs * 1000);
+#endif
+  } while(intervalMs > 0);
+
+  return 0;
+}
@@ -0,0 +1,171 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ClockSource.h
+// Project:     perfLib
+// Purpose:     Selectable high-resolution clocks for timers (non-Win32)
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PERFCLOCKSOURCE_H__
+#define _PERFCLOCKSOURCE_H__
+
+// ----------------------------------------------------------------------------
+// Description
+// ----------------------------------------------------------------------------
+/// \file ClockSource.h
+///
+/// Source of "cpu ticks" used by timers on non-Win32 platforms (see cpu_time_ticks).
+///
+/// - TSC: invariant time stamp counter (rdtsc or rdtscp), a few ns per read;
+///   frequency is calibrated against CLOCK_MONOTONIC and skew of counters
+///   of all cores is measured with a handshake between two pinned threads - 
+///   TSC is used only if both checks pass
+/// - monotonic: CLOCK_MONOTONIC, read through vDSO (no syscall), ns resolution
+/// - coarse: CLOCK_MONOTONIC_COARSE, cheapest read, resolution of scheduler tick (1-4ms)
+/// - thread: CLOCK_THREAD_CPUTIME_ID, CPU time of calling thread - timer must be
+///   started & stopped by the same thread
+/// - process: clock(), CPU time of whole process (previous behaviour)
+///
+/// Source is chosen by ClockSource::init, which should be called at startup,
+/// before any timer is used: value of PERF_CLOCK environment variable
+/// (tsc, tscp, monotonic, coarse, thread, process) or TSC if reliable,
+/// monotonic otherwise. TSC calibration takes ~20ms and moves calling 
+/// thread between cores, so it is never done on first use of a timer - 
+/// without init() the first clock read selects PERF_CLOCK source (if it 
+/// is not TSC) or monotonic. Ticks of different sources cannot be mixed,
+/// so init() or ClockSource::select must be called before any timer is used.
+
+// ----------------------------------------------------------------------------
+// Headers
+// ----------------------------------------------------------------------------
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PERF_HAS_TSC
+#include <x86intrin.h>
+#endif
+
+#include "perf/details/ptypes.h"
+#include "perf/details/atomic_ops.h"
+
+namespace perf {
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+enum ClockSourceKind {
+  /// Source not selected yet
+  cskNone,
+  /// TSC read with rdtsc - lowest overhead, can be reordered with nearby instructions
+  cskTsc,
+  /// TSC read with rdtscp - waits for preceding instructions
+  cskTscOrdered,
+  cskMonotonic,
+  cskMonotonicCoarse,
+  cskThreadCpu,
+  cskProcessCpu
+};
+
+/// Time of TSC frequency measurement
+const uint CLOCK_TSC_CALIBRATION_MS = 20;
+/// Number of round trips of skew handshake with each core
+const uint CLOCK_TSC_HANDSHAKE_ROUNDS = 200;
+/// Max difference of TSC-based time between cores
+const uint64 CLOCK_TSC_MAX_SKEW_NS = 1000;
+
+// ----------------------------------------------------------------------------
+// Class definitions
+// ----------------------------------------------------------------------------
+/// Result of TSC calibration
+struct ClockCalibration {
+  /// TSC ticks per second
+  uint64 frequency;
+  /// Max TSC offset of a core against the first one, proven by handshake (lower bound)
+  uint64 maxSkewNs;
+  /// Number of checked cores
+  uint cpuCount;
+  /// CPU reports invariant (constant rate, not stopped in sleep states) TSC
+  bool invariant;
+  bool hasRdtscp;
+  /// All checks passed, TSC can be used
+  bool reliable;
+};
+
+/// Global clock used by timers
+class ClockSource {
+public:
+  /// Returns current time in ticks of selected source
+  static cpu_ticks now()
+  {
+    switch(Details::atomic_load_acquire(&m_kind)) {
+#ifdef PERF_HAS_TSC
+      case cskTsc:
+        return __rdtsc();
+      case cskTscOrdered:
+      {
+        unsigned int aux;
+        return __rdtscp(&aux);
+      }
+#endif
+      case cskMonotonic:
+        return readClock(CLOCK_MONOTONIC);
+#ifdef CLOCK_MONOTONIC_COARSE
+      case cskMonotonicCoarse:
+        return readClock(CLOCK_MONOTONIC_COARSE);
+#endif
+      case cskThreadCpu:
+        return readClock(CLOCK_THREAD_CPUTIME_ID);
+      case cskProcessCpu:
+        return readProcessCpu();
+      default:
+        // no calibration here, see init()
+        selectDefault(false);
+        return now();
+    }
+  }
+  /// Selects default source (see file description), calibrates TSC if needed.
+  /// Call at startup, before any timer is used - does nothing if source is already selected.
+  static void init();
+  /// Selects clock source, must be called before timers are used.
+  /// \return <false> if source is not available, selection is not changed then
+  static bool select(ClockSourceKind kind);
+  /// Selects source by name (see getName)
+  static bool select(const char *name);
+  static ClockSourceKind getKind();
+  static const char *getName(ClockSourceKind kind);
+  /// \return <true> if source can be selected
+  static bool isAvailable(ClockSourceKind kind);
+  /// Returns number of ticks per second of selected source
+  static uint64 getFrequency();
+  static uint64 ticksToNs(cpu_ticks ticks);
+  static cpu_ticks ticksToMs(cpu_ticks ticks);
+  /// Returns result of TSC calibration, calibrates on first call
+  static const ClockCalibration &getTscCalibration();
+protected:
+  /// Selects PERF_CLOCK or default source if none is selected yet, 
+  /// TSC sources are considered only if <allowTsc> is set
+  static void selectDefault(bool allowTsc);
+  static cpu_ticks readClock(clockid_t id)
+  {
+    struct timespec ts;
+    if (clock_gettime(id, &ts) != 0)
+      return 0;
+    return static_cast<cpu_ticks>(ts.tv_sec) * 1000000000ULL + static_cast<cpu_ticks>(ts.tv_nsec);
+  }
+  static cpu_ticks readProcessCpu();
+  static void calibrateTsc(ClockCalibration &output);
+  /// Returns max offset (ticks) between TSC of calling thread's core and TSC of other allowed cores
+  static uint64 measureTscSkew(uint &cpuCount);
+  static void setKind(ClockSourceKind kind);
+private:
+  static volatile uint m_kind;
+  // ticks per second of selected source
+  static uint64 m_frequency;
+  static ClockCalibration m_calibration;
+  static volatile uint m_calibrated;
+};
+
+}; // namespace perf
+
+#endif // _PERFCLOCKSOURCE_H__
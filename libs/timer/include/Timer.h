@@ -15,7 +15,10 @@
 // ----------------------------------------------------------------------------
 /// \file Timer.h
 ///
-///
+/// Global timers (Timer) keep start time and nesting depth per thread, in thread's 
+/// stack of active timers, so the same timer can be measured by many threads at once.
+/// Each stop adds measured interval to timer's total without lock.
+/// Timer has to be stopped by the thread which started it.
 
 #define PERF_TIMER_USE_UNORDERED
 
@@ -28,8 +31,20 @@
 #include "boost/ptr_container/ptr_map.hpp"
 #endif
 
+#include <vector>
+
 //#include "sc/utils.h"
 #include "perf/details/ptypes.h"
+#include "perf/details/platform.h"
+#include "perf/details/atomic_ops.h"
+#include "perf/details/NameHash.h"
+#include "perf/details/NameRegistry.h"
+#include "perf/details/NameTrie.h"
+#include "perf/details/RejectedNameCache.h"
+#include "perf/details/DirtyTracker.h"
+#include "perf/CompiledFilter.h"
+#include "perf/Histogram.h"
+#include "perf/time_utils.h"
 
 namespace perf {
 
@@ -39,33 +54,124 @@ namespace perf {
 // ----------------------------------------------------------------------------
 // Forward class definitions
 // ----------------------------------------------------------------------------
+class Timer;
+
+namespace Details {
+  class TimerItem;
+
+  /// Timer resolved on first use, stored in static variable
+  struct StaticTimerRef {
+    TimerItem * volatile item;
+    const char *name;
+  };
+
+#ifdef PERF_HAS_CONSTEXPR
+  /// Single static timer reference for each distinct name hash
+  template<uint64 NameHash>
+  struct StaticTimerSlot {
+    static StaticTimerRef ref;
+  };
+
+  template<uint64 NameHash>
+  StaticTimerRef StaticTimerSlot<NameHash>::ref = { DTP_NULL, DTP_NULL };
+#endif
+};
 
 // ----------------------------------------------------------------------------
 // Constants
 // ----------------------------------------------------------------------------
+/// Timer used for names rejected by registry limits (see Timer::setCapacity)
+const char * const TIMER_OVERFLOW_NAME = "perf.overflow";
+/// Max number of timers with interval histograms (see Timer::enableHistogram)
+const uint TIMER_MAX_HISTOGRAMS = 1024;
+/// Value of running count of timer being removed, enter() refuses such timer
+const uint TIMER_REMOVED_MARK = 0x80000000U;
+/// Number of low bits of timer's histogram value used by histogram id + 1, 
+/// remaining bits keep generation of id (see Timer::resetHistogram)
+const uint TIMER_HISTOGRAM_ID_BITS = 11;
+const uint TIMER_HISTOGRAM_ID_MASK = (1U << TIMER_HISTOGRAM_ID_BITS) - 1;
+const uint TIMER_HISTOGRAM_GENERATION_MASK = ~0U >> TIMER_HISTOGRAM_ID_BITS;
 
 // ----------------------------------------------------------------------------
 // Class definitions
 // ----------------------------------------------------------------------------
+/// Statistics of timer, times in nanoseconds
+struct TimerStats {
+  /// Number of measured intervals (stops, scopes)
+  uint64 count;
+  /// Total time including time restored from previous run, saturated at max uint64 (584 years)
+  uint64 totalNs;
+  uint64 minNs;
+  uint64 maxNs;
+  /// Last measured interval
+  uint64 lastNs;
+  /// Total time in seconds, not limited
+  double totalSec;
+  /// Mean of intervals measured by current run
+  double meanNs;
+  uint64 getTotalMs() const { return totalNs / 1000000; }
+};
+
 // ----------------------------------------------------------------------------
 // Timer
 // ----------------------------------------------------------------------------
 namespace Details {
   class TimerItem {
   public:
-    TimerItem() {m_lock = 0; m_totalTime = 0; }
+    TimerItem() {m_lock = 0; m_running = 0; m_restoredMs = 0; m_index = 0; m_histogram = 0; m_pinned = false; reset(); }
     ~TimerItem() {}
     void start();
     /// returns <true> if stop was performed successfuly
     bool stop(cpu_ticks a_stopTime = 0);
+    /// Adds ticks to total time
     void inc(cpu_ticks value);
+    /// Adds measured interval: total, count, min, max & last
+    void record(cpu_ticks elapsed);
     void reset();
+    /// Adds time (ms) saved by previous run
+    void restore(cpu_ticks ms);
+    /// Returns total time in ms
     cpu_ticks getTotal();
+    void getStats(TimerStats &output);
     bool isRunning();
+    /// Called when global timer is started by a thread (nesting is tracked by thread)
+    /// \return <false> if timer is being removed, it must not be used then
+    bool enter();
+    /// Marks timer as removed if it is not running, atomically with enter() of other threads
+    bool markRemoved();
+    /// Called when thread stops global timer, adds measured ticks to total
+    void leave(cpu_ticks elapsed);
+    /// Called when thread exits with timer still running, measured time is lost
+    void abandon() { atomic_fetch_add(&m_running, static_cast<uint>(-1)); }
+    /// Marks global timer referenced by handle, such timer is never removed
+    void pin() { m_pinned = true; }
+    bool isPinned() const { return m_pinned; }
+    /// Index in global registry
+    void setIndex(uint value) { m_index = value; }
+    uint getIndex() const { return m_index; }
+    /// Id + 1 & generation of interval histogram of global timer, 0 = no histogram
+    void setHistogram(uint value) { atomic_store(&m_histogram, value); }
+    uint getHistogram() const { return atomic_load(&m_histogram); }
   private:
+    // used by LocalTimer only
     cpu_ticks m_startTime;
-    cpu_ticks m_totalTime;
+    // total ticks: 128-bit value, high part is increased when low part wraps
+    volatile cpu_ticks m_totalTime;
+    volatile uint64 m_totalHigh;
+    volatile uint64 m_count;
+    // interval stats, in ticks
+    volatile cpu_ticks m_minTime;
+    volatile cpu_ticks m_maxTime;
+    volatile cpu_ticks m_lastTime;
+    // total time of previous runs, in ms
+    volatile cpu_ticks m_restoredMs;
+    // nesting depth, used by LocalTimer only
     uint m_lock;
+    // number of threads with started global timer
+    volatile uint m_running;
+    uint m_index;
+    volatile uint m_histogram;
+    bool m_pinned;
   };
 
 #ifdef PERF_TIMER_USE_UNORDERED
@@ -73,6 +179,88 @@ namespace Details {
 #else
   typedef boost::ptr_map<dtpString,TimerItem> TimerItemMapColn;
 #endif
+
+  /// global timers, lookups without lock
+  typedef NameRegistry<TimerItem> TimerItemRegistry;
+
+  /// Global timer started by a thread
+  struct ActiveTimer {
+    TimerItem *item;
+    cpu_ticks startTime;
+    uint depth;
+  };
+
+  /// Thread's part of timer histogram
+  struct HistogramShard {
+    Histogram histogram;
+    // (generation << 1) of histogram id recorded in shard, odd while owner thread
+    // resets shard for a newer generation. Readers skip shards of other generations.
+    volatile uint state;
+
+    /// \return <true> if shard contains intervals of <generation>
+    bool hasGeneration(uint generation) const
+    {
+      return (atomic_load_acquire(&state) == (generation << 1));
+    }
+  };
+
+  /// Global timers started by a thread, most recently started on top.
+  /// Keeps also thread's shards of timer histograms.
+  class TimerStack {
+  public:
+    TimerStack() { m_histograms = DTP_NULL; m_next = DTP_NULL; }
+    /// Releases timers still running and histogram shards
+    ~TimerStack();
+    /// Returns position of timer or -1 if it is not started by thread
+    int find(const TimerItem *item) const
+    {
+      // timers are usually stopped in reverse order
+      for(int i = static_cast<int>(m_timers.size()) - 1; i >= 0; i--)
+        if (m_timers[i].item == item)
+          return i;
+      return -1;
+    }
+    ActiveTimer &at(int pos) { return m_timers[pos]; }
+    void push(TimerItem *item, cpu_ticks startTime);
+    void erase(int pos) { m_timers.erase(m_timers.begin() + pos); }
+    /// Returns thread's shard of histogram <id> for <generation>, allocates it if needed 
+    /// and resets it if it was recorded for older generation, owner thread only.
+    /// \return NULL if shard already records newer generation
+    Histogram *getShard(uint id, uint generation);
+    /// Returns shard of histogram <id> or NULL if thread did not record it, any thread
+    const HistogramShard *findShard(uint id) const;
+    /// Unlinks shard of released histogram <id> and retires it with Epoch, any thread
+    void releaseShard(uint id);
+  protected:
+    static void deleteShardFunc(void *shard);
+  private:
+    friend class perf::Timer;
+    std::vector<ActiveTimer> m_timers;
+    // shards indexed by histogram id, table is allocated on first use
+    HistogramShard * volatile * volatile m_histograms;
+    TimerStack *m_next;
+  };
+};
+
+/// Pre-resolved global timer, see Timer::registerName
+class TimerHandle {
+public:
+  TimerHandle() { m_item = DTP_NULL; }
+  bool isNull() const { return (m_item == DTP_NULL); }
+protected:
+  explicit TimerHandle(Details::TimerItem *item) { m_item = item; }
+private:
+  friend class Timer;
+  Details::TimerItem *m_item;
+};
+
+/// Visitor of timer interval histograms (values in ns), see Timer::visitHistograms
+class TimerHistogramVisitorIntf {
+public:
+  TimerHistogramVisitorIntf() {}
+  virtual ~TimerHistogramVisitorIntf() {}
+  /// Called with histogram merged from shards of all threads
+  virtual void visitHistogram(const dtpString &timerName, const Histogram &histogram) = 0;
 };
 
 /// Timer visitor
@@ -80,7 +268,10 @@ class TimerVisitorIntf {
 public:
   TimerVisitorIntf() {}
   virtual ~TimerVisitorIntf() {}
+  /// Called with total time in ms
   virtual void visit(const dtpString &timerName, cpu_ticks value) = 0;
+  /// Called for each visited timer, by default reports total time in ms with visit()
+  virtual void visitStats(const dtpString &timerName, const TimerStats &stats);
 };
 
 enum TimerStatusFlag {
@@ -93,27 +284,158 @@ const uint tsfAny = tsfRunning + tfsStopped;
 /// global timer collection
 class Timer {
 public:
+  /// Limits number of timers and approximate memory of their registry 
+  /// and name index (zero = no limit).
+  /// Names registered above the limit are folded into TIMER_OVERFLOW_NAME timer.
+  /// Rejected names are cached (see Counter::setCapacity), so their next uses 
+  /// do not take the registry lock and each one is counted once.
+  static void setCapacity(uint maxItems, size_t maxMemory);
+  /// Returns number of rejected names
+  static uint64 getRejectedCount();
   static void start(const dtpString &a_name);
   /// \return <true> if stop was performed successfuly
   static bool stop(const dtpString &a_name);
   static void reset(const dtpString &a_name);
   static void inc(const dtpString &a_name, cpu_ticks value);
+  /// Returns total time in ms
   static cpu_ticks getTotal(const dtpString &a_name);
+  /// Returns total time in ns
+  static uint64 getTotalNs(const dtpString &a_name);
+  static void getStats(const dtpString &a_name, TimerStats &output);
   static bool isRunning(const dtpString &a_name);
+  /// Adds total time (ms) saved by previous run of process to timer.
+  /// Limited like start(): above capacity (see setCapacity) time is added to TIMER_OVERFLOW_NAME timer.
+  static void restore(const dtpString &a_name, cpu_ticks ms);
+  /// Resolves timer name once, returned handle can be used instead of name
+  static TimerHandle registerName(const dtpString &a_name);
+  /// Returns handle stored in static reference, resolves it on first use
+  static TimerHandle resolve(Details::StaticTimerRef &ref, const char *a_name);
+  static void start(TimerHandle handle);
+  /// \return <true> if stop was performed successfuly
+  static bool stop(TimerHandle handle);
+  static void reset(TimerHandle handle);
+  static void inc(TimerHandle handle, cpu_ticks value);
+  /// Adds interval (in ticks) measured outside of timer, updates count, min, max & last interval
+  static void record(TimerHandle handle, cpu_ticks elapsed);
+  static cpu_ticks getTotal(TimerHandle handle);
+  static void getStats(TimerHandle handle, TimerStats &output);
+  /// Starts (or stops) recording each interval of timer in a histogram, resets it's histogram.
+  /// Each thread records to it's own shard (~15 kB, allocated on first record), shards are merged on read.
+  /// Shards are kept until histogram is disabled (or timer removed) or thread exits, 
+  /// so memory cost is up to 15 kB * threads * timers with histograms.
+  /// \return <false> if TIMER_MAX_HISTOGRAMS limit is reached
+  static bool enableHistogram(const dtpString &a_name, bool enabled = true);
+  static bool hasHistogram(const dtpString &a_name);
+  /// Returns histogram of intervals (ns) of timer, empty if not enabled
+  static void getHistogram(const dtpString &a_name, Histogram &output);
+  static void getHistogramStats(const dtpString &a_name, HistogramStats &output);
+  /// \return interval (ns) below or equal to which <percent> of intervals fall
+  static uint64 getPercentile(const dtpString &a_name, double percent);
+  /// Visits histograms of all timers which have them
+  static void visitHistograms(TimerHistogramVisitorIntf *visitor);
+  static bool isRunning(TimerHandle handle);
+  /// Removes timer, memory is released when no thread can use it.
+  /// Timers referenced by handles (registerName, PERF_TIMER_START) are not removed.
+  /// \return <true> if timer has been removed
+  static bool remove(const dtpString &a_name);
+  /// Removes timers matching any of patterns, returns number of removed timers
+  static uint removeByFilter(const dtp::dnode &filterList);
+  static uint removeByFilter(CompiledFilter &filter);
   static void visitAll(TimerVisitorIntf *visitor);
+  /// Visits timers changed (stopped, increased, reset) after generation <since> returned by previous call.
+  /// All timers are visited if since = 0 or changes are no longer known.
+  /// \return current generation
+  static uint64 visitChanged(uint64 since, TimerVisitorIntf *visitor);
   static void getAll(dtp::dnode &output);
   static void getByFilter(const dtp::dnode &filterList, dtp::dnode &output, uint statusMask = tsfAny);
+  /// Reports timers matching filter, keep filter between calls to reuse it's cache
+  static void getByFilter(CompiledFilter &filter, dtp::dnode &output, uint statusMask = tsfAny);
+  /// Visits timers with names starting with <prefix>
+  static void visitByPrefix(const dtpString &prefix, TimerVisitorIntf *visitor);
+  /// Returns sum of timers with names starting with <prefix> (e.g. "db.pool.")
+  static cpu_ticks getTotalByPrefix(const dtpString &prefix);
 protected:
+  /// Finds indexes of timers with a given name prefix
+  static void findByPrefix(const dtpString &prefix, std::vector<uint> &output);
   static Details::TimerItem *addItem(const dtpString &a_name);
   static Details::TimerItem *getItem(const dtpString &a_name);
   static Details::TimerItem *checkItem(const dtpString &a_name);
+  /// Finds or adds timer and marks it as referenced by handle
+  static Details::TimerItem *pinItem(const dtpString &a_name);
+  /// Deletes removed registry entry (EpochDeleter)
+  static void releaseItem(void *entry);
+  static bool stopItem(Details::TimerItem *item, cpu_ticks stopTime);
+  /// Starts item for current thread, returns <false> if item is being removed
+  static bool startItem(Details::TimerItem *item);
+  /// Records interval in thread's shard of timer histogram (id + 1 & generation), 
+  /// interval is dropped if histogram was reset or released since value was read
+  static void recordHistogram(Details::TimerStack *stack, uint histogram, cpu_ticks elapsed);
+  /// Merges shards of histogram <id> recorded for it's current generation into output
+  static void mergeHistogram(uint id, Histogram &output);
+  /// Resets histogram by moving it's id to next generation, shards are reset 
+  /// by their owner threads. Returns new histogram value (id + 1 & generation).
+  static uint resetHistogram(uint histogram);
+  /// Resets histogram & returns it's id to free list
+  static void releaseHistogram(uint histogram);
+  static uint histogramId(uint histogram) { return (histogram & TIMER_HISTOGRAM_ID_MASK) - 1; }
+  static uint histogramGeneration(uint histogram) { return histogram >> TIMER_HISTOGRAM_ID_BITS; }
+  static uint makeHistogram(uint id, uint generation) { return (generation << TIMER_HISTOGRAM_ID_BITS) | (id + 1); }
+  /// Marks timer as changed for visitChanged
+  static void markChanged(Details::TimerItem *item);
+  static Details::TimerItem *resolveItem(Details::StaticTimerRef &ref, const char *a_name);
+  /// Returns stack of timers started by current thread
+  static Details::TimerStack *currentStack()
+  {
+    Details::TimerStack *res = m_stack;
+    if (PERF_UNLIKELY(res == DTP_NULL))
+      res = attachStack();
+    return res;
+  }
+  static Details::TimerStack *attachStack();
+  /// Deletes stack of exiting thread
+  static void releaseStack(Details::TimerStack *stack);
   static dtp::dnode removeNonMatching(const dtp::dnode &input, const dtp::dnode &filterList, uint statusMask);
 private:
-#ifdef PERF_TIMER_USE_UNORDERED
-  static boost::shared_ptr<Details::TimerItemMapColn> m_items;
-#else
-  static Details::TimerItemMapColn m_items;
-#endif
+  static Details::TimerItemRegistry m_items;
+  static volatile uint64 m_rejected;
+  // prefix index of timer names
+  static Details::NameTrie m_names;
+  // names folded into overflow timer
+  static Details::RejectedNameCache m_rejectedNames;
+  // indexes of changed timers
+  static Details::DirtyTracker m_changes;
+  static PERF_THREAD_LOCAL Details::TimerStack *m_stack;
+  // stacks of all threads
+  static Details::TimerStack *m_stacks;
+  // shards of exited threads
+  static Histogram *m_retiredHistograms[TIMER_MAX_HISTOGRAMS];
+  // current generation of each histogram id
+  static volatile uint m_histogramGenerations[TIMER_MAX_HISTOGRAMS];
+  static std::vector<uint> m_freeHistograms;
+  static uint m_histogramCount;
+};
+
+/// Measures time of enclosing scope and adds it to global timer, see PERF_SCOPE.
+/// Reads clock once on construction and once on destruction, does not use
+/// thread's timer stack, so nested scopes of the same timer are added separately
+/// and isRunning does not report them.
+class ScopedTimer {
+public:
+  explicit ScopedTimer(TimerHandle handle): m_handle(handle) 
+  { 
+    m_startTime = cpu_time_ticks(); 
+  }
+  ~ScopedTimer()
+  {
+    Timer::record(m_handle, calc_cpu_time_delay(m_startTime, cpu_time_ticks()));
+  }
+private:
+  // no copy
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer &operator=(const ScopedTimer &);
+private:
+  TimerHandle m_handle;
+  cpu_ticks m_startTime;
 };
 
 /// local, private timer collection
@@ -141,5 +463,65 @@ private:
   Details::TimerItemMapColn m_items;
 };
 
+// ----------------------------------------------------------------------------
+// Inline functions
+// ----------------------------------------------------------------------------
+inline TimerHandle Timer::resolve(Details::StaticTimerRef &ref, const char *a_name)
+{
+  Details::TimerItem *item = Details::atomic_load_acquire(&ref.item);
+  if (PERF_UNLIKELY(item == DTP_NULL))
+    item = resolveItem(ref, a_name);
+  // different names with the same hash would share a timer
+  assert((ref.name == a_name) || (strcmp(ref.name, a_name) == 0));
+  return TimerHandle(item);
+}
+
 }; // namespace perf
+
+// ----------------------------------------------------------------------------
+// Macros
+// ----------------------------------------------------------------------------
+#define PERF_TIMER_CONCAT_(a, b) a##b
+#define PERF_TIMER_CONCAT(a, b) PERF_TIMER_CONCAT_(a, b)
+
+#ifdef PERF_HAS_CONSTEXPR
+#define PERF_TIMER_STATIC_REF(a_name) \
+  perf::Details::StaticTimerSlot<perf::Details::name_hash(a_name)>::ref
+
+/// Starts global timer with a name given as string literal.
+/// Name is resolved only once, then it's timer is used directly.
+/// Usage: PERF_TIMER_START("db.query"); ... PERF_TIMER_STOP("db.query");
+#define PERF_TIMER_START(a_name) \
+  perf::Timer::start(perf::Timer::resolve(PERF_TIMER_STATIC_REF(a_name), a_name))
+
+/// Stops global timer with a name given as string literal
+#define PERF_TIMER_STOP(a_name) \
+  perf::Timer::stop(perf::Timer::resolve(PERF_TIMER_STATIC_REF(a_name), a_name))
+
+/// Measures time from this line to the end of scope (also on return or exception)
+/// with global timer named by string literal.
+/// Usage: void parse() { PERF_SCOPE("parser.parse"); ... }
+#define PERF_SCOPE(a_name) \
+  perf::ScopedTimer PERF_TIMER_CONCAT(perfScopedTimer, __LINE__)( \
+    perf::Timer::resolve(PERF_TIMER_STATIC_REF(a_name), a_name))
+#else
+// no compile-time hashing - one static reference per call site
+#define PERF_TIMER_START(a_name) \
+  do { \
+    static perf::Details::StaticTimerRef perfTimerRef = { DTP_NULL, DTP_NULL }; \
+    perf::Timer::start(perf::Timer::resolve(perfTimerRef, a_name)); \
+  } while(0)
+
+#define PERF_TIMER_STOP(a_name) \
+  do { \
+    static perf::Details::StaticTimerRef perfTimerRef = { DTP_NULL, DTP_NULL }; \
+    perf::Timer::stop(perf::Timer::resolve(perfTimerRef, a_name)); \
+  } while(0)
+
+#define PERF_SCOPE(a_name) \
+  static perf::Details::StaticTimerRef PERF_TIMER_CONCAT(perfScopeRef, __LINE__) = { DTP_NULL, DTP_NULL }; \
+  perf::ScopedTimer PERF_TIMER_CONCAT(perfScopedTimer, __LINE__)( \
+    perf::Timer::resolve(PERF_TIMER_CONCAT(perfScopeRef, __LINE__), a_name))
+#endif
+
 #endif // _PERFTIMER_H__
@@ -41,6 +41,7 @@
 
 cpu_ticks w32_cpu_time_ticks();
 cpu_ticks w32_cpu_time_ticks_to_ms(cpu_ticks ticks);
+cpu_ticks w32_cpu_time_ticks_per_sec();
 cpu_ticks w32_os_uptime_ms();
 
 #endif // _W32TIMER_H__
@@ -51,6 +51,16 @@ cpu_ticks cpu_time_ticks_to_ms(cpu_ticks ticks);
 #define cpu_time_ticks w32_cpu_time_ticks
 #endif
 
+/// Returns number of "cpu ticks" per second
+#ifndef PERF_USE_WIN32_TICKS
+cpu_ticks cpu_time_ticks_per_sec();
+#else
+#define cpu_time_ticks_per_sec w32_cpu_time_ticks_per_sec
+#endif
+
+/// Converts time expressed in "cpu ticks" to nanosecs, without overflow of intermediate values
+uint64 cpu_time_ticks_to_ns(cpu_ticks ticks);
+
 /// Checks if elapsed time is already greater then a specified delay
 /// \return <true> if a specified delay elapsed from a given start time
 bool is_cpu_time_elapsed_ms(cpu_ticks a_startTime, cpu_ticks a_delay);
@@ -58,6 +68,7 @@ bool is_cpu_time_elapsed_ms(cpu_ticks a_startTime, cpu_ticks a_delay);
 /// Calculates time passed between given start & end time (units: can be ticks or msecs)
 uint64 calc_cpu_time_delay(uint64 startTime, uint64 endTime);
 
+/// Returns monotonic time in millisecs (system uptime)
 uint64 os_uptime_ms();
 
 #endif // _PERFTIMEUTILS_H__
@@ -0,0 +1,387 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        ClockSource.cpp
+// Project:     perfLib
+// Purpose:     Selectable high-resolution clocks for timers (non-Win32)
+// Author:      Piotr Likus
+// Modified by:
+// Created:     17/10/2026
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef WIN32
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+#include "perf/ClockSource.h"
+
+#ifdef PERF_HAS_TSC
+#include <cpuid.h>
+#endif
+
+#ifdef DEBUG_MEM
+#include "dbg/DebugMem.h"
+#endif
+
+using namespace perf;
+
+// ----------------------------------------------------------------------------
+// Local definitions
+// ----------------------------------------------------------------------------
+static const char * const clock_source_names[] = {
+  "none", "tsc", "tscp", "monotonic", "coarse", "thread", "process"
+};
+
+const uint CLOCK_SOURCE_COUNT = sizeof(clock_source_names) / sizeof(clock_source_names[0]);
+
+#ifdef PERF_HAS_TSC
+// Reads TSC & CLOCK_MONOTONIC at (almost) the same moment: clock read is
+// surrounded by two TSC reads, pair with the shortest distance is used
+static void read_tsc_pair(uint64 &tsc, uint64 &ns)
+{
+  unsigned int aux;
+  uint64 best = ~static_cast<uint64>(0);
+  uint64 t0, t1;
+  struct timespec ts;
+
+  for(uint i=0; i != 8; i++)
+  {
+    t0 = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t1 = __rdtscp(&aux);
+    if (t1 - t0 < best)
+    {
+      best = t1 - t0;
+      tsc = t0 + (t1 - t0) / 2;
+      ns = static_cast<uint64>(ts.tv_sec) * 1000000000ULL + static_cast<uint64>(ts.tv_nsec);
+    }
+  }
+}
+
+#ifdef __linux__
+// State shared by reference thread and responder pinned to checked core
+struct TscHandshake {
+  int cpu;
+  // 1 - responder is pinned, 2 - it could not be pinned
+  volatile uint ready;
+  volatile uint64 request;
+  volatile uint64 replyRound;
+  volatile uint64 reply;
+};
+
+// Answers each request round with TSC of it's core
+static void *tsc_handshake_responder(void *arg)
+{
+  TscHandshake *handshake = static_cast<TscHandshake *>(arg);
+  cpu_set_t single;
+  unsigned int aux;
+
+  CPU_ZERO(&single);
+  CPU_SET(handshake->cpu, &single);
+  if (sched_setaffinity(0, sizeof(single), &single) != 0)
+  {
+    perf::Details::atomic_store_release(&handshake->ready, 2U);
+    return DTP_NULL;
+  }
+  perf::Details::atomic_store_release(&handshake->ready, 1U);
+
+  for(uint64 round=1; round <= CLOCK_TSC_HANDSHAKE_ROUNDS; round++)
+  {
+    while(perf::Details::atomic_load_acquire(&handshake->request) != round) {}
+    handshake->reply = __rdtscp(&aux);
+    perf::Details::atomic_store_release(&handshake->replyRound, round);
+  }
+  return DTP_NULL;
+}
+#endif // __linux__
+#endif // PERF_HAS_TSC
+
+// ----------------------------------------------------------------------------
+// ClockSource
+// ----------------------------------------------------------------------------
+volatile uint ClockSource::m_kind = cskNone;
+uint64 ClockSource::m_frequency = 0;
+ClockCalibration ClockSource::m_calibration;
+volatile uint ClockSource::m_calibrated = 0;
+
+void ClockSource::init()
+{
+  selectDefault(true);
+}
+
+void ClockSource::selectDefault(bool allowTsc)
+{
+  ClockSourceKind kind = cskNone;
+
+  if (Details::atomic_load_acquire(&m_kind) != cskNone)
+    return;
+
+  const char *name = getenv("PERF_CLOCK");
+  if (name != DTP_NULL)
+    for(uint i=cskNone + 1; i != CLOCK_SOURCE_COUNT; i++)
+    {
+      bool tsc = ((i == cskTsc) || (i == cskTscOrdered));
+      if ((strcmp(name, clock_source_names[i]) == 0) && (allowTsc || !tsc) && isAvailable(static_cast<ClockSourceKind>(i)))
+        kind = static_cast<ClockSourceKind>(i);
+    }
+
+  if (kind == cskNone)
+  {
+    if (allowTsc && getTscCalibration().reliable)
+      kind = getTscCalibration().hasRdtscp ? cskTscOrdered : cskTsc;
+    else
+      kind = cskMonotonic;
+  }
+
+#pragma omp critical(perf_clock)
+{
+  // source could be selected by other thread in the meantime
+  if (Details::atomic_load(&m_kind) == cskNone)
+    setKind(kind);
+}
+}
+
+void ClockSource::setKind(ClockSourceKind kind)
+{
+  switch(kind) {
+    case cskTsc:
+    case cskTscOrdered:
+      m_frequency = getTscCalibration().frequency;
+      break;
+    case cskProcessCpu:
+      m_frequency = CLOCKS_PER_SEC;
+      break;
+    default:
+      m_frequency = 1000000000ULL;
+      break;
+  }
+  // frequency is visible before kind
+  Details::atomic_store_release(&m_kind, static_cast<uint>(kind));
+}
+
+bool ClockSource::select(ClockSourceKind kind)
+{
+  if (!isAvailable(kind))
+    return false;
+#pragma omp critical(perf_clock)
+{
+  setKind(kind);
+}
+  return true;
+}
+
+bool ClockSource::select(const char *name)
+{
+  for(uint i=cskNone + 1; i != CLOCK_SOURCE_COUNT; i++)
+    if (strcmp(name, clock_source_names[i]) == 0)
+      return select(static_cast<ClockSourceKind>(i));
+  return false;
+}
+
+ClockSourceKind ClockSource::getKind()
+{
+  if (Details::atomic_load_acquire(&m_kind) == cskNone)
+    selectDefault(false);
+  return static_cast<ClockSourceKind>(Details::atomic_load_acquire(&m_kind));
+}
+
+const char *ClockSource::getName(ClockSourceKind kind)
+{
+  return (static_cast<uint>(kind) < CLOCK_SOURCE_COUNT) ? clock_source_names[kind] : clock_source_names[cskNone];
+}
+
+bool ClockSource::isAvailable(ClockSourceKind kind)
+{
+  struct timespec ts;
+
+  switch(kind) {
+    case cskTsc:
+      return getTscCalibration().reliable;
+    case cskTscOrdered:
+      return getTscCalibration().reliable && getTscCalibration().hasRdtscp;
+    case cskMonotonic:
+      return (clock_getres(CLOCK_MONOTONIC, &ts) == 0);
+#ifdef CLOCK_MONOTONIC_COARSE
+    case cskMonotonicCoarse:
+      return (clock_getres(CLOCK_MONOTONIC_COARSE, &ts) == 0);
+#endif
+    case cskThreadCpu:
+      return (clock_getres(CLOCK_THREAD_CPUTIME_ID, &ts) == 0);
+    case cskProcessCpu:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint64 ClockSource::getFrequency()
+{
+  if (Details::atomic_load_acquire(&m_kind) == cskNone)
+    selectDefault(false);
+  return m_frequency;
+}
+
+uint64 ClockSource::ticksToNs(cpu_ticks ticks)
+{
+  uint64 freq = getFrequency();
+  // split to avoid overflow of ticks * 10^9
+  return (ticks / freq) * 1000000000ULL + ((ticks % freq) * 1000000000ULL) / freq;
+}
+
+cpu_ticks ClockSource::ticksToMs(cpu_ticks ticks)
+{
+  uint64 freq = getFrequency();
+  return (ticks / freq) * 1000ULL + ((ticks % freq) * 1000ULL) / freq;
+}
+
+cpu_ticks ClockSource::readProcessCpu()
+{
+  clock_t t = clock();
+  if (t != static_cast<clock_t>(-1))
+    return t;
+  else
+    return 0;
+}
+
+const ClockCalibration &ClockSource::getTscCalibration()
+{
+  if (Details::atomic_load_acquire(&m_calibrated) == 0)
+  {
+#pragma omp critical(perf_clock_calibration)
+{
+    if (m_calibrated == 0)
+    {
+      calibrateTsc(m_calibration);
+      Details::atomic_store_release(&m_calibrated, 1U);
+    }
+}
+  }
+  return m_calibration;
+}
+
+void ClockSource::calibrateTsc(ClockCalibration &output)
+{
+  memset(&output, 0, sizeof(output));
+#ifdef PERF_HAS_TSC
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && (eax >= 0x80000007))
+  {
+    __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    output.hasRdtscp = ((edx & (1U << 27)) != 0);
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    output.invariant = ((edx & (1U << 8)) != 0);
+  }
+  // calibration pairs are read with rdtscp
+  if (!output.invariant || !output.hasRdtscp)
+    return;
+
+  uint64 tsc0, ns0, tsc1, ns1;
+  struct timespec delay;
+  delay.tv_sec = 0;
+  delay.tv_nsec = CLOCK_TSC_CALIBRATION_MS * 1000000L;
+
+  read_tsc_pair(tsc0, ns0);
+  while(nanosleep(&delay, &delay) != 0) {}
+  read_tsc_pair(tsc1, ns1);
+
+  if ((ns1 <= ns0) || (tsc1 <= tsc0))
+    return;
+  output.frequency = static_cast<uint64>(static_cast<double>(tsc1 - tsc0) * 1e9 / static_cast<double>(ns1 - ns0));
+  if (output.frequency == 0)
+    return;
+
+  // cross-core check: offsets of TSC of other cores, measured in ticks
+  uint64 skew = measureTscSkew(output.cpuCount);
+  output.maxSkewNs = static_cast<uint64>(static_cast<double>(skew) * 1e9 / static_cast<double>(output.frequency));
+  output.reliable = (output.maxSkewNs <= CLOCK_TSC_MAX_SKEW_NS);
+#endif
+}
+
+uint64 ClockSource::measureTscSkew(uint &cpuCount)
+{
+  uint64 res = 0;
+  cpuCount = 0;
+#if defined(PERF_HAS_TSC) && defined(__linux__)
+  // Each round: reference thread reads TSC (t0), sends request, responder 
+  // on checked core replies with it's TSC, reference thread reads TSC again (t1).
+  // Reply was read between t0 and t1, so offset of checked core is within 
+  // [reply - t1, reply - t0] - only offset outside of the narrowest such range 
+  // across rounds is a proven skew (unlike comparison with CLOCK_MONOTONIC, 
+  // which is not precise enough).
+  cpu_set_t original, single;
+  int refCpu = -1;
+  unsigned int aux;
+
+  if (sched_getaffinity(0, sizeof(original), &original) != 0)
+    return 0;
+
+  for(int cpu=0; cpu != CPU_SETSIZE; cpu++)
+  {
+    if (!CPU_ISSET(cpu, &original))
+      continue;
+
+    if (refCpu < 0)
+    {
+      // calling thread stays on the first allowed core
+      CPU_ZERO(&single);
+      CPU_SET(cpu, &single);
+      if (sched_setaffinity(0, sizeof(single), &single) != 0)
+        return 0;
+      refCpu = cpu;
+      cpuCount++;
+      continue;
+    }
+
+    TscHandshake handshake;
+    memset(&handshake, 0, sizeof(handshake));
+    handshake.cpu = cpu;
+    pthread_t responder;
+    if (pthread_create(&responder, DTP_NULL, tsc_handshake_responder, &handshake) != 0)
+      continue;
+
+    uint ready;
+    while((ready = Details::atomic_load_acquire(&handshake.ready)) == 0) {}
+
+    if (ready == 1)
+    {
+      int64 minOffset = static_cast<int64>(~static_cast<uint64>(0) >> 1);
+      int64 maxOffset = -minOffset;
+      for(uint64 round=1; round <= CLOCK_TSC_HANDSHAKE_ROUNDS; round++)
+      {
+        uint64 t0 = __rdtscp(&aux);
+        Details::atomic_store_release(&handshake.request, round);
+        while(Details::atomic_load_acquire(&handshake.replyRound) != round) {}
+        uint64 t1 = __rdtscp(&aux);
+
+        int64 low = static_cast<int64>(handshake.reply - t1);
+        int64 high = static_cast<int64>(handshake.reply - t0);
+        if (low > maxOffset)
+          maxOffset = low;
+        if (high < minOffset)
+          minOffset = high;
+      }
+
+      // maxOffset is highest lower bound, minOffset lowest upper bound
+      uint64 skew = 0;
+      if (maxOffset > 0)
+        skew = static_cast<uint64>(maxOffset);
+      else if (minOffset < 0)
+        skew = static_cast<uint64>(-minOffset);
+      if (skew > res)
+        res = skew;
+      cpuCount++;
+    }
+
+    pthread_join(responder, DTP_NULL);
+  }
+
+  sched_setaffinity(0, sizeof(original), &original);
+#endif
+  return res;
+}
+
+#endif // WIN32
@@ -9,9 +9,13 @@
 
 //#include "sc/defs.h"
 
-#include "base/wildcard.h"
 #include "base/string.h"
 
+#include <algorithm>
+#include <stdexcept>
+
+#include "boost/thread/tss.hpp"
+
 #include "perf/Timer.h"
 #include "perf/time_utils.h"
 
@@ -29,7 +33,15 @@
 
 using namespace perf;
 
-//TODO: add destruction of timers
+// ----------------------------------------------------------------------------
+// Local functions
+// ----------------------------------------------------------------------------
+static void build_filter(const dtp::dnode &filterList, CompiledFilter &output)
+{
+  output.clear();
+  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
+    output.addPattern(filterList.getString(j));
+}
 
 // ----------------------------------------------------------------------------
 // Details::TimerItem
@@ -58,62 +70,233 @@ bool Details::TimerItem::stop(cpu_ticks a_stopTime)
       stopTime = cpu_time_ticks();
     else
       stopTime = a_stopTime;
-    m_totalTime += (calc_cpu_time_delay(m_startTime, stopTime));
+    record(calc_cpu_time_delay(m_startTime, stopTime));
   }
   return res;
 }
 
+void Details::TimerItem::leave(cpu_ticks elapsed)
+{
+  record(elapsed);
+  atomic_fetch_add(&m_running, static_cast<uint>(-1));
+}
+
 void Details::TimerItem::inc(cpu_ticks value)
 {
-  m_totalTime += value;
+  cpu_ticks prev = atomic_fetch_add(&m_totalTime, value);
+  // carry to high part
+  if (PERF_UNLIKELY(prev + value < prev))
+    atomic_fetch_add(&m_totalHigh, static_cast<uint64>(1));
+}
+
+void Details::TimerItem::record(cpu_ticks elapsed)
+{
+  cpu_ticks curr;
+
+  inc(elapsed);
+  atomic_fetch_add(&m_count, static_cast<uint64>(1));
+  atomic_store(&m_lastTime, elapsed);
+
+  curr = atomic_load(&m_minTime);
+  while((elapsed < curr) && !atomic_cas(&m_minTime, curr, elapsed))
+    curr = atomic_load(&m_minTime);
+
+  curr = atomic_load(&m_maxTime);
+  while((elapsed > curr) && !atomic_cas(&m_maxTime, curr, elapsed))
+    curr = atomic_load(&m_maxTime);
 }
 
 void Details::TimerItem::reset()
 {
+  // intervals measured by threads are added when they stop
   m_lock = 0;
-  m_totalTime = 0;
+  atomic_store(&m_totalTime, static_cast<cpu_ticks>(0));
+  atomic_store(&m_totalHigh, static_cast<uint64>(0));
+  atomic_store(&m_count, static_cast<uint64>(0));
+  atomic_store(&m_minTime, ~static_cast<cpu_ticks>(0));
+  atomic_store(&m_maxTime, static_cast<cpu_ticks>(0));
+  atomic_store(&m_lastTime, static_cast<cpu_ticks>(0));
+  atomic_store(&m_restoredMs, static_cast<cpu_ticks>(0));
+}
+
+void Details::TimerItem::restore(cpu_ticks ms)
+{
+  // writers are serialized by caller, readers do not lock
+  atomic_store(&m_restoredMs, atomic_load(&m_restoredMs) + ms);
 }
 
 cpu_ticks Details::TimerItem::getTotal()
 {
-  return cpu_time_ticks_to_ms(m_totalTime);
+  return cpu_time_ticks_to_ms(atomic_load(&m_totalTime)) + atomic_load(&m_restoredMs);
+}
+
+void Details::TimerItem::getStats(TimerStats &output)
+{
+  cpu_ticks total;
+  uint64 high;
+  uint64 highAfter = atomic_load_acquire(&m_totalHigh);
+  // both parts of total must come from the same carry period - retry if high part changed
+  do {
+    high = highAfter;
+    total = atomic_load_acquire(&m_totalTime);
+    highAfter = atomic_load_acquire(&m_totalHigh);
+  } while(high != highAfter);
+  cpu_ticks restoredMs = atomic_load(&m_restoredMs);
+  double freq = static_cast<double>(cpu_time_ticks_per_sec());
+  // 2^64
+  const double highUnit = 18446744073709551616.0;
+
+  output.count = atomic_load(&m_count);
+  output.minNs = (output.count > 0) ? cpu_time_ticks_to_ns(atomic_load(&m_minTime)) : 0;
+  output.maxNs = cpu_time_ticks_to_ns(atomic_load(&m_maxTime));
+  output.lastNs = cpu_time_ticks_to_ns(atomic_load(&m_lastTime));
+
+  double measuredSec = (static_cast<double>(high) * highUnit + static_cast<double>(total)) / freq;
+  output.totalSec = measuredSec + static_cast<double>(restoredMs) / 1000.0;
+  output.meanNs = (output.count > 0) ? (measuredSec * 1e9 / static_cast<double>(output.count)) : 0.0;
+
+  uint64 restoredNs = restoredMs * 1000000ULL;
+  uint64 totalNs = cpu_time_ticks_to_ns(total);
+  if ((high != 0) || (output.totalSec >= highUnit / 1e9) || (totalNs + restoredNs < totalNs))
+    output.totalNs = ~static_cast<uint64>(0);
+  else
+    output.totalNs = totalNs + restoredNs;
 }
 
 bool Details::TimerItem::isRunning()
 {
-  return (m_lock > 0);
+  return (m_lock > 0) || (atomic_load(&m_running) > 0);
 }
 
-template<typename map_type>
-struct map_deleter
+bool Details::TimerItem::enter()
 {
-    void operator()(void *ptr) const
-    {
-         map_type *map = static_cast<map_type *>(ptr);
-         for(map_type::iterator it = map->begin(), epos = map->end(); it != epos; ++it)
-           delete (it->second);
-         map->erase(map->begin(), map->end());
-         delete map;
-    }
-};
+  uint running;
+  do {
+    running = atomic_load(&m_running);
+    if (running == TIMER_REMOVED_MARK)
+      return false;
+  } while(!atomic_cas(&m_running, running, running + 1));
+  return true;
+}
+
+bool Details::TimerItem::markRemoved()
+{
+  return (m_lock == 0) && atomic_cas(&m_running, 0U, TIMER_REMOVED_MARK);
+}
 
 // ----------------------------------------------------------------------------
-// Timer
+// TimerVisitorIntf
 // ----------------------------------------------------------------------------
+void TimerVisitorIntf::visitStats(const dtpString &timerName, const TimerStats &stats)
+{
+  visit(timerName, stats.getTotalMs());
+}
 
-#ifdef PERF_TIMER_USE_UNORDERED
-boost::shared_ptr<Details::TimerItemMapColn> Timer::m_items(new Details::TimerItemMapColn(), map_deleter<Details::TimerItemMapColn>());
-#else
-Details::TimerItemMapColn Timer::m_items;
-#endif
+// ----------------------------------------------------------------------------
+// Details::TimerStack
+// ----------------------------------------------------------------------------
+Details::TimerStack::~TimerStack()
+{
+  for(uint i=0, epos = m_timers.size(); i != epos; i++)
+    m_timers[i].item->abandon();
 
-void Timer::start(const dtpString &a_name)
+  if (m_histograms != DTP_NULL)
+  {
+    for(uint i=0; i != TIMER_MAX_HISTOGRAMS; i++)
+      delete m_histograms[i];
+    delete [] m_histograms;
+  }
+}
+
+Histogram *Details::TimerStack::getShard(uint id, uint generation)
 {
-  Details::TimerItem *item = checkItem(a_name);
-#pragma omp critical(timer)
+  assert(id < TIMER_MAX_HISTOGRAMS);
+  HistogramShard * volatile *table = m_histograms;
+  if (PERF_UNLIKELY(table == DTP_NULL))
+  {
+    table = new HistogramShard *[TIMER_MAX_HISTOGRAMS];
+    for(uint i=0; i != TIMER_MAX_HISTOGRAMS; i++)
+      table[i] = DTP_NULL;
+    atomic_store_release(&m_histograms, table);
+  }
+
+  // shard can be unlinked by releaseShard() in the meantime, caller is inside epoch guard
+  HistogramShard *res = atomic_load_acquire(&table[id]);
+  if (PERF_UNLIKELY(res == DTP_NULL))
+  {
+    res = new HistogramShard();
+    res->state = generation << 1;
+    atomic_store_release(&table[id], res);
+  }
+  else if (PERF_UNLIKELY(res->state != (generation << 1)))
+  {
+    // shard only rolls forward, interval of older generation is dropped (generations wrap)
+    uint age = (generation - (res->state >> 1)) & TIMER_HISTOGRAM_GENERATION_MASK;
+    if (age > (TIMER_HISTOGRAM_GENERATION_MASK >> 1))
+      return DTP_NULL;
+    // histogram was reset (or id reused) - only owner thread writes to shard, 
+    // odd state makes readers skip it until reset is done
+    atomic_store(&res->state, (generation << 1) | 1);
+    atomic_thread_fence();
+    res->histogram.reset();
+    atomic_store_release(&res->state, generation << 1);
+  }
+  return &res->histogram;
+}
+
+const Details::HistogramShard *Details::TimerStack::findShard(uint id) const
 {
-  item->start();
+  HistogramShard * volatile *table = atomic_load_acquire(&m_histograms);
+  if (table == DTP_NULL)
+    return DTP_NULL;
+  return atomic_load_acquire(&table[id]);
 }
+
+void Details::TimerStack::releaseShard(uint id)
+{
+  HistogramShard * volatile *table = atomic_load_acquire(&m_histograms);
+  if (table == DTP_NULL)
+    return;
+  HistogramShard *shard = atomic_exchange(&table[id], static_cast<HistogramShard *>(DTP_NULL));
+  if (shard != DTP_NULL)
+    Epoch::retire(shard, &TimerStack::deleteShardFunc);
+}
+
+void Details::TimerStack::deleteShardFunc(void *shard)
+{
+  delete static_cast<HistogramShard *>(shard);
+}
+
+void Details::TimerStack::push(TimerItem *item, cpu_ticks startTime)
+{
+  ActiveTimer timer;
+  timer.item = item;
+  timer.startTime = startTime;
+  timer.depth = 1;
+  m_timers.push_back(timer);
+}
+
+// ----------------------------------------------------------------------------
+// Timer
+// ----------------------------------------------------------------------------
+Details::TimerItemRegistry Timer::m_items(true);
+Details::NameTrie Timer::m_names;
+Details::RejectedNameCache Timer::m_rejectedNames;
+Details::DirtyTracker Timer::m_changes;
+volatile uint64 Timer::m_rejected = 0;
+PERF_THREAD_LOCAL Details::TimerStack *Timer::m_stack = DTP_NULL;
+Details::TimerStack *Timer::m_stacks = DTP_NULL;
+Histogram *Timer::m_retiredHistograms[TIMER_MAX_HISTOGRAMS];
+volatile uint Timer::m_histogramGenerations[TIMER_MAX_HISTOGRAMS];
+std::vector<uint> Timer::m_freeHistograms;
+uint Timer::m_histogramCount = 0;
+
+// timers found by name can be removed concurrently - they are used inside epoch guard
+void Timer::start(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  // timer removed after lookup is found again as a new item
+  while(!startItem(checkItem(a_name))) {}
 }
 
 bool Timer::stop(const dtpString &a_name)
@@ -124,11 +307,8 @@ bool Timer::stop(const dtpString &a_name)
 #endif
 
   cpu_ticks stopTime = cpu_time_ticks();
-  Details::TimerItem *item = checkItem(a_name);
-#pragma omp critical(timer)
-{
-  return item->stop(stopTime);
-}
+  Details::EpochGuard guard;
+  return stopItem(checkItem(a_name), stopTime);
 }
 
 void Timer::reset(const dtpString &a_name)
@@ -138,82 +318,543 @@ void Timer::reset(const dtpString &a_name)
     std::cout << "DEBUG-reset: " << a_name << std::endl;
 #endif
 
+  Details::EpochGuard guard;
+  reset(TimerHandle(checkItem(a_name)));
+}
+
+void Timer::inc(const dtpString &a_name, cpu_ticks value)
+{
+  Details::EpochGuard guard;
+  inc(TimerHandle(checkItem(a_name)), value);
+}
+
+cpu_ticks Timer::getTotal(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  return getTotal(TimerHandle(checkItem(a_name)));
+}
+
+uint64 Timer::getTotalNs(const dtpString &a_name)
+{
+  TimerStats stats;
+  getStats(a_name, stats);
+  return stats.totalNs;
+}
+
+void Timer::getStats(const dtpString &a_name, TimerStats &output)
+{
+  Details::EpochGuard guard;
+  getStats(TimerHandle(checkItem(a_name)), output);
+}
+
+bool Timer::isRunning(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  return isRunning(TimerHandle(checkItem(a_name)));
+}
+
+void Timer::restore(const dtpString &a_name, cpu_ticks ms)
+{
+  Details::EpochGuard guard;
   Details::TimerItem *item = checkItem(a_name);
 #pragma omp critical(timer)
 {
-  item->reset();
+  item->restore(ms);
 }
+  markChanged(item);
 }
 
-void Timer::inc(const dtpString &a_name, cpu_ticks value)
+TimerHandle Timer::registerName(const dtpString &a_name)
 {
-  Details::TimerItem *item = checkItem(a_name);
+  return TimerHandle(pinItem(a_name));
+}
 
+Details::TimerItem *Timer::pinItem(const dtpString &a_name)
+{
+  Details::TimerItem *res;
+  // under the same lock as remove(), so timer cannot be removed before it is pinned
 #pragma omp critical(timer)
 {
-  item->inc(value);
+  res = getItem(a_name);
+  if (!res)
+    res = addItem(a_name);
+  res->pin();
 }
+  return res;
 }
 
-cpu_ticks Timer::getTotal(const dtpString &a_name)
+bool Timer::remove(const dtpString &a_name)
+{
+  Details::TimerItemRegistry::Entry *entry = DTP_NULL;
+#pragma omp critical(timer)
+{
+  Details::TimerItem *item = getItem(a_name);
+  // running timer is referenced by stacks of threads, mark makes concurrent start() look it up again
+  if ((item != DTP_NULL) && !item->isPinned() && item->markRemoved())
+  {
+    entry = m_items.remove(a_name);
+    m_names.remove(a_name, entry->index);
+    // rejected names can fit again after enough removals
+    m_rejectedNames.release();
+  }
+}
+  if (entry == DTP_NULL)
+    return false;
+
+  Details::Epoch::retire(entry, &Timer::releaseItem);
+  Details::Epoch::reclaim();
+  return true;
+}
+
+uint Timer::removeByFilter(const dtp::dnode &filterList)
+{
+  CompiledFilter filter;
+  build_filter(filterList, filter);
+  return removeByFilter(filter);
+}
+
+uint Timer::removeByFilter(CompiledFilter &filter)
+{
+  std::vector<dtpString> names;
+  {
+    Details::EpochGuard guard;
+    const Details::TimerItemRegistry::Entry *entry;
+    for (uint i=0, epos = m_items.size(); i != epos; i++)
+    {
+      entry = m_items.at(i);
+      if ((entry != DTP_NULL) && !entry->value->isPinned() && filter.isMatching(entry->name))
+        names.push_back(entry->name);
+    }
+  }
+
+  uint res = 0;
+  for (uint i=0, epos = names.size(); i != epos; i++)
+    if (remove(names[i]))
+      res++;
+  return res;
+}
+
+void Timer::releaseItem(void *entry)
+{
+  Details::TimerItemRegistry::Entry *removed = static_cast<Details::TimerItemRegistry::Entry *>(entry);
+  uint histogram = removed->value->getHistogram();
+  if (histogram != 0)
+    releaseHistogram(histogram);
+#pragma omp critical(timer)
+{
+  m_items.release(removed);
+}
+}
+
+Details::TimerItem *Timer::resolveItem(Details::StaticTimerRef &ref, const char *a_name)
+{
+  Details::TimerItem *res = pinItem(a_name);
+  // concurrent resolves of the same name store the same values
+  ref.name = a_name;
+  Details::atomic_store_release(&ref.item, res);
+  return res;
+}
+
+Details::TimerStack *Timer::attachStack()
+{
+  std::auto_ptr<Details::TimerStack> guard(new Details::TimerStack());
+#pragma omp critical(timer_stack)
+{
+  // owner of thread's stack, calls releaseStack() on thread exit
+  static boost::thread_specific_ptr<Details::TimerStack> owner(&Timer::releaseStack);
+  owner.reset(guard.get());
+  guard->m_next = m_stacks;
+  m_stacks = guard.get();
+}
+  m_stack = guard.release();
+  return m_stack;
+}
+
+void Timer::releaseStack(Details::TimerStack *stack)
+{
+#pragma omp critical(timer_stack)
+{
+  Details::TimerStack **prev = &m_stacks;
+  while((*prev != DTP_NULL) && (*prev != stack))
+    prev = &((*prev)->m_next);
+  if (*prev != DTP_NULL)
+    *prev = stack->m_next;
+
+  // recorded intervals are kept after thread exits, generations are changed under the same lock
+  const Details::HistogramShard *shard;
+  for(uint i=0; i != TIMER_MAX_HISTOGRAMS; i++)
+  {
+    shard = stack->findShard(i);
+    if ((shard == DTP_NULL) || !shard->hasGeneration(m_histogramGenerations[i]))
+      continue;
+    if (m_retiredHistograms[i] == DTP_NULL)
+      m_retiredHistograms[i] = new Histogram();
+    m_retiredHistograms[i]->merge(shard->histogram);
+  }
+}
+  if (m_stack == stack)
+    m_stack = DTP_NULL;
+  delete stack;
+}
+
+void Timer::start(TimerHandle handle)
+{
+  assert(!handle.isNull());
+  // timers referenced by handles are never removed
+  bool started = startItem(handle.m_item);
+  assert(started);
+  (void)started;
+}
+
+bool Timer::startItem(Details::TimerItem *item)
+{
+  Details::TimerStack *stack = currentStack();
+  int pos = stack->find(item);
+  if (pos >= 0)
+  {
+    // nested start in the same thread
+    stack->at(pos).depth++;
+    return true;
+  }
+
+  if (!item->enter())
+    return false;
+  stack->push(item, cpu_time_ticks());
+  return true;
+}
+
+bool Timer::stop(TimerHandle handle)
+{
+  assert(!handle.isNull());
+  return stopItem(handle.m_item, cpu_time_ticks());
+}
+
+bool Timer::stopItem(Details::TimerItem *item, cpu_ticks stopTime)
+{
+  Details::TimerStack *stack = currentStack();
+  int pos = stack->find(item);
+  // not started by this thread
+  if (pos < 0)
+    return false;
+
+  Details::ActiveTimer &timer = stack->at(pos);
+  if (timer.depth > 1)
+  {
+    timer.depth--;
+    return false;
+  }
+
+  cpu_ticks elapsed = calc_cpu_time_delay(timer.startTime, stopTime);
+  item->leave(elapsed);
+  stack->erase(pos);
+
+  uint histogram = item->getHistogram();
+  if (histogram != 0)
+    recordHistogram(stack, histogram, elapsed);
+  markChanged(item);
+  return true;
+}
+
+void Timer::recordHistogram(Details::TimerStack *stack, uint histogram, cpu_ticks elapsed)
+{
+  uint id = histogramId(histogram);
+  uint generation = histogramGeneration(histogram);
+  // histogram was reset or id released after timer was read - interval belongs to old generation.
+  // If reset happens after this check, shard keeps old generation and readers skip it.
+  if (generation != Details::atomic_load_acquire(&m_histogramGenerations[id]))
+    return;
+  // shard of released id can be retired concurrently
+  Details::EpochGuard guard;
+  Histogram *shard = stack->getShard(id, generation);
+  if (shard != DTP_NULL)
+    shard->recordSingleWriter(cpu_time_ticks_to_ns(elapsed));
+}
+
+void Timer::mergeHistogram(uint id, Histogram &output)
+{
+#pragma omp critical(timer_stack)
+{
+  uint generation = m_histogramGenerations[id];
+  const Details::HistogramShard *shard;
+  for(Details::TimerStack *stack = m_stacks; stack != DTP_NULL; stack = stack->m_next)
+  {
+    shard = stack->findShard(id);
+    if ((shard != DTP_NULL) && shard->hasGeneration(generation))
+      output.merge(shard->histogram);
+  }
+  if (m_retiredHistograms[id] != DTP_NULL)
+    output.merge(*m_retiredHistograms[id]);
+}
+}
+
+uint Timer::resetHistogram(uint histogram)
 {
+  uint id = histogramId(histogram);
+  uint generation;
+#pragma omp critical(timer_stack)
+{
+  // shards of threads are not touched here, owners reset them on next record
+  generation = (m_histogramGenerations[id] + 1) & TIMER_HISTOGRAM_GENERATION_MASK;
+  Details::atomic_store_release(&m_histogramGenerations[id], generation);
+  if (m_retiredHistograms[id] != DTP_NULL)
+    m_retiredHistograms[id]->reset();
+}
+  return makeHistogram(id, generation);
+}
+
+void Timer::releaseHistogram(uint histogram)
+{
+  uint id = histogramId(histogram);
+  // threads still holding old value drop their intervals
+  resetHistogram(histogram);
+#pragma omp critical(timer_stack)
+{
+  // memory of free id is not kept, shards are allocated again when id is reused
+  for(Details::TimerStack *stack = m_stacks; stack != DTP_NULL; stack = stack->m_next)
+    stack->releaseShard(id);
+  delete m_retiredHistograms[id];
+  m_retiredHistograms[id] = DTP_NULL;
+}
+#pragma omp critical(timer)
+{
+  m_freeHistograms.push_back(id);
+}
+}
+
+bool Timer::enableHistogram(const dtpString &a_name, bool enabled)
+{
+  Details::EpochGuard guard;
   Details::TimerItem *item = checkItem(a_name);
+  uint prev = 0;
+  bool res = true;
+
+#pragma omp critical(timer)
+{
+  prev = item->getHistogram();
+  if (enabled && (prev != 0))
+  {
+    item->setHistogram(resetHistogram(prev));
+  }
+  else if (enabled)
+  {
+    uint id = TIMER_MAX_HISTOGRAMS;
+    if (!m_freeHistograms.empty())
+    {
+      id = m_freeHistograms.back();
+      m_freeHistograms.pop_back();
+    }
+    else if (m_histogramCount < TIMER_MAX_HISTOGRAMS)
+      id = m_histogramCount++;
+
+    if (id < TIMER_MAX_HISTOGRAMS)
+      item->setHistogram(makeHistogram(id, Details::atomic_load(&m_histogramGenerations[id])));
+    else
+      res = false;
+  }
+  else
+    item->setHistogram(0);
+}
+
+  if (!enabled && (prev != 0))
+    releaseHistogram(prev);
+  return res;
+}
+
+bool Timer::hasHistogram(const dtpString &a_name)
+{
+  Details::EpochGuard guard;
+  return (checkItem(a_name)->getHistogram() != 0);
+}
+
+void Timer::getHistogram(const dtpString &a_name, Histogram &output)
+{
+  Details::EpochGuard guard;
+  uint histogram = checkItem(a_name)->getHistogram();
+  output.reset();
+  if (histogram != 0)
+    mergeHistogram(histogramId(histogram), output);
+}
+
+void Timer::getHistogramStats(const dtpString &a_name, HistogramStats &output)
+{
+  std::auto_ptr<Histogram> merged(new Histogram());
+  getHistogram(a_name, *merged);
+  merged->getStats(output);
+}
+
+uint64 Timer::getPercentile(const dtpString &a_name, double percent)
+{
+  std::auto_ptr<Histogram> merged(new Histogram());
+  getHistogram(a_name, *merged);
+  return merged->getPercentile(percent);
+}
+
+void Timer::visitHistograms(TimerHistogramVisitorIntf *visitor)
+{
+  // delete items removed since previous visit
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+  std::auto_ptr<Histogram> merged(new Histogram());
+  const Details::TimerItemRegistry::Entry *entry;
+  uint histogram;
+
+  for (uint i=0, epos = m_items.size(); i != epos; i++)
+  {
+    entry = m_items.at(i);
+    if (entry == DTP_NULL)
+      continue;
+    histogram = entry->value->getHistogram();
+    if (histogram == 0)
+      continue;
+    merged->reset();
+    mergeHistogram(histogramId(histogram), *merged);
+    visitor->visitHistogram(entry->name, *merged);
+  }
+}
+
+void Timer::markChanged(Details::TimerItem *item)
+{
+  m_changes.mark(item->getIndex());
+}
+
+void Timer::reset(TimerHandle handle)
+{
+  assert(!handle.isNull());
+#pragma omp critical(timer)
+{
+  handle.m_item->reset();
+  // under the same lock as enableHistogram
+  uint histogram = handle.m_item->getHistogram();
+  if (histogram != 0)
+    handle.m_item->setHistogram(resetHistogram(histogram));
+}
+  markChanged(handle.m_item);
+}
+
+void Timer::inc(TimerHandle handle, cpu_ticks value)
+{
+  assert(!handle.isNull());
+  handle.m_item->inc(value);
+  markChanged(handle.m_item);
+}
+
+void Timer::record(TimerHandle handle, cpu_ticks elapsed)
+{
+  assert(!handle.isNull());
+  handle.m_item->record(elapsed);
+
+  uint histogram = handle.m_item->getHistogram();
+  if (histogram != 0)
+    recordHistogram(currentStack(), histogram, elapsed);
+  markChanged(handle.m_item);
+}
+
+void Timer::getStats(TimerHandle handle, TimerStats &output)
+{
+  assert(!handle.isNull());
+  // fields are read with atomic loads, no lock
+  handle.m_item->getStats(output);
+}
+
+cpu_ticks Timer::getTotal(TimerHandle handle)
+{
+  assert(!handle.isNull());
   cpu_ticks res;
 #pragma omp critical(timer)
 {
-  res = item->getTotal();
+  res = handle.m_item->getTotal();
 }
   return res;
 }
 
-bool Timer::isRunning(const dtpString &a_name)
+bool Timer::isRunning(TimerHandle handle)
 {
-  Details::TimerItem *item = checkItem(a_name);
+  assert(!handle.isNull());
   bool res;
 #pragma omp critical(timer)
 {
-  res = item->isRunning();
+  res = handle.m_item->isRunning();
 }
   return res;
 }
 
 Details::TimerItem *Timer::addItem(const dtpString &a_name)
 {
-  std::auto_ptr<Details::TimerItem> guard(new Details::TimerItem());
-#ifdef PERF_TIMER_USE_UNORDERED
-  m_items->insert(Details::TimerItemMapColn::value_type(a_name, guard.get()));
-#else
-  m_items.insert(const_cast<dtpString &>(a_name), guard.get());
-#endif
-  return guard.release();
+  if (!m_items.canInsert(a_name, m_names.getMemoryUsage() + m_names.insertCost(a_name)))
+  {
+    // overflow timer is registered by setCapacity
+    Details::TimerItem *overflow = m_items.find(TIMER_OVERFLOW_NAME);
+    if (overflow == DTP_NULL)
+      throw std::length_error("too many timers");
+    // name is counted again only if it could not be cached
+    uint64 hash = Details::name_hash(a_name);
+    if (!m_rejectedNames.contains(a_name, hash))
+    {
+      m_rejectedNames.insert(a_name, hash);
+      Details::atomic_fetch_add(&m_rejected, static_cast<uint64>(1));
+    }
+    return overflow;
+  }
+
+  Details::TimerItem *res = new Details::TimerItem();
+  res->setIndex(m_items.nextIndex());
+  m_items.insert(a_name, Details::name_hash(a_name), res);
+  m_names.insert(a_name, res->getIndex());
+  markChanged(res);
+  return res;
 }
 
-Details::TimerItem *Timer::getItem(const dtpString &a_name)
+void Timer::findByPrefix(const dtpString &prefix, std::vector<uint> &output)
 {
-  Details::TimerItemMapColn::iterator p;
+#pragma omp critical(timer)
+{
+  m_names.findByPrefix(prefix, output);
+}
+}
 
-#ifdef PERF_TIMER_USE_UNORDERED
-  Details::TimerItemMapColn *items = m_items.get();
-#else
-  Details::TimerItemMapColn *items = &m_items;
-#endif
+void Timer::setCapacity(uint maxItems, size_t maxMemory)
+{
+  pinItem(TIMER_OVERFLOW_NAME);
+#pragma omp critical(timer)
+{
+  m_items.setLimits(maxItems, maxMemory);
+  m_rejectedNames.clear();
+}
+}
 
-  p = items->find(a_name);
-  if(p != items->end())
-    return (p->second);
-  else
-    return DTP_NULL;
+uint64 Timer::getRejectedCount()
+{
+  return Details::atomic_load(&m_rejected);
+}
+
+Details::TimerItem *Timer::getItem(const dtpString &a_name)
+{
+  return m_items.find(a_name);
 }
 
 Details::TimerItem *Timer::checkItem(const dtpString &a_name)
 {
-  Details::TimerItem *res;
+  // lock-free lookup, existing items are found here in almost every call
+  uint64 hash = Details::name_hash(a_name);
+  Details::TimerItem *res = m_items.find(a_name, hash);
+  // names rejected before go to overflow timer without the lock
+  if ((res == DTP_NULL) && m_rejectedNames.contains(a_name, hash))
+    res = getItem(TIMER_OVERFLOW_NAME);
+  // cache of rejected names is full and registry too, new name is counted without the lock
+  if ((res == DTP_NULL) && m_rejectedNames.isOverflowing())
+  {
+    Details::atomic_fetch_add(&m_rejected, static_cast<uint64>(1));
+    res = getItem(TIMER_OVERFLOW_NAME);
+  }
+  if (res == DTP_NULL)
+  {
 #pragma omp critical(timer)
 {
-  res = getItem(a_name);
-  if (!res)
-    res = addItem(a_name);
+    res = getItem(a_name);
+    if (!res)
+      res = addItem(a_name);
 }
+  }
   assert(res != DTP_NULL);
   return res;
 }
@@ -225,23 +866,24 @@ dtp::dnode Timer::removeNonMatching(const dtp::dnode &input, const dtp::dnode &f
   bool bRunning;
   bool bIncludeRunning = (statusMask & tsfRunning) != 0; 
   bool bIncludeStopped = (statusMask & tfsStopped) != 0;
+  CompiledFilter filter;
 
   res.setAsParent();
+  build_filter(filterList, filter);
 
-  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
+  for(uint i=0, epos = input.size(); i != epos; i++)
   {
-    WildcardMatcher matcher(filterList.getString(j));
-    for(uint i=0, epos = input.size(); i != epos; i++)
+    name = input.getElementName(i);
+    if (!filter.isMatching(name))
+      continue;
+
+    bRunning = isRunning(name);
+
+    if ((bRunning && bIncludeRunning) ||
+        (!bRunning && bIncludeStopped))
     {
-      name = input.getElementName(i);
-      bRunning = isRunning(name);
-
-      if ((bRunning && bIncludeRunning) ||
-          (!bRunning && bIncludeStopped))
-      {
-            if (!res.hasChild(name) && matcher.isMatching(name))
-              res.addChild(name, new dtp::dnode(input.getElement(i)));
-      }
+      if (!res.hasChild(name))
+        res.addChild(name, new dtp::dnode(input.getElement(i)));
     }
   }
 
@@ -250,41 +892,82 @@ dtp::dnode Timer::removeNonMatching(const dtp::dnode &input, const dtp::dnode &f
 
 void Timer::visitAll(TimerVisitorIntf *visitor)
 {
-#ifdef PERF_TIMER_USE_UNORDERED
-  Details::TimerItemMapColn *items = m_items.get();
-#else
-  Details::TimerItemMapColn *items = &m_items;
-#endif
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+  TimerStats stats;
+  const Details::TimerItemRegistry::Entry *entry;
 
-  cpu_ticks itemTime;
-  for (Details::TimerItemMapColn::iterator p = items->begin(); p != items->end(); p++)
+  for (uint i=0, epos = m_items.size(); i != epos; i++)
   {
-    itemTime = p->second->getTotal();
-    visitor->visit(p->first, itemTime);
+    entry = m_items.at(i);
+    if (entry == DTP_NULL)
+      continue;
+    entry->value->getStats(stats);
+    visitor->visitStats(entry->name, stats);
   }
 }
 
+uint64 Timer::visitChanged(uint64 since, TimerVisitorIntf *visitor)
+{
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+  std::vector<uint> indexes;
+  bool complete;
+  const Details::TimerItemRegistry::Entry *entry;
+  TimerStats stats;
+  uint64 res = m_changes.getChanged(since, indexes, complete);
+
+  uint count = m_items.size();
+  if (!complete)
+  {
+    indexes.resize(count);
+    for (uint i=0; i != count; i++)
+      indexes[i] = i;
+  }
+
+  for (uint i=0, epos = indexes.size(); i != epos; i++)
+  {
+    if (indexes[i] >= count)
+      break;
+    entry = m_items.at(indexes[i]);
+    if (entry != DTP_NULL)
+    {
+      entry->value->getStats(stats);
+      visitor->visitStats(entry->name, stats);
+    }
+  }
+  return res;
+}
+
 void Timer::getAll(dtp::dnode &output)
 {
   cpu_ticks itemTime;
 
+  const Details::TimerItemRegistry::Entry *entry;
+  Details::Epoch::reclaimPending();
+  Details::EpochGuard guard;
+
   output.clear();
   output.setAsParent();
 
-#ifdef PERF_TIMER_USE_UNORDERED
-  Details::TimerItemMapColn *items = m_items.get();
-#else
-  Details::TimerItemMapColn *items = &m_items;
-#endif
-
-  for (Details::TimerItemMapColn::iterator p = items->begin(); p != items->end(); p++)
+  for (uint i=0, epos = m_items.size(); i != epos; i++)
   {
-    itemTime = p->second->getTotal();
-    output.addChild(p->first, new dtp::dnode(itemTime));
+    entry = m_items.at(i);
+    if (entry == DTP_NULL)
+      continue;
+    itemTime = entry->value->getTotal();
+    output.addChild(entry->name, new dtp::dnode(itemTime));
   }
 }
 
 void Timer::getByFilter(const dtp::dnode &filterList, dtp::dnode &output, uint statusMask)
+{
+  CompiledFilter filter;
+  build_filter(filterList, filter);
+  getByFilter(filter, output, statusMask);
+}
+
+void Timer::getByFilter(CompiledFilter &filter, dtp::dnode &output, uint statusMask)
 {
   dtpString itemName;
   bool bRunning;
@@ -294,37 +977,93 @@ void Timer::getByFilter(const dtp::dnode &filterList, dtp::dnode &output, uint s
   output.clear();
   output.setAsParent();
 
-#ifdef PERF_TIMER_USE_UNORDERED
-  Details::TimerItemMapColn *items = m_items.get();
-#else
-  Details::TimerItemMapColn *items = &m_items;
-#endif
-
-  if (items->empty())
+  if (m_items.empty())
     return;
 
-  boost::ptr_vector<WildcardMatcher> matchers;
+  Details::EpochGuard guard;
+  const Details::TimerItemRegistry::Entry *entry;
+  std::vector<uint> indexes;
+  bool scanAll = false;
 
-  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
-    matchers.push_back(new WildcardMatcher(filterList.getString(j)));
+  // only subtrees of literal prefixes of patterns are checked
+  for(uint j=0, eposj = filter.getPatternCount(); j != eposj; j++)
+  {
+    dtpString prefix = Details::wildcard_prefix(filter.getPattern(j));
+    if (prefix.empty())
+    {
+      scanAll = true;
+      break;
+    }
+    findByPrefix(prefix, indexes);
+  }
 
-  for (Details::TimerItemMapColn::iterator p = items->begin(); p != items->end(); p++)
+  if (scanAll)
+  {
+    indexes.resize(m_items.size());
+    for (uint i=0, epos = indexes.size(); i != epos; i++)
+      indexes[i] = i;
+  }
+  else
   {
-    itemName = p->first;
-    bRunning = p->second->isRunning();
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+  }
+
+  for (uint i=0, epos = indexes.size(); i != epos; i++)
+  {
+    entry = m_items.at(indexes[i]);
+    if (entry == DTP_NULL)
+      continue;
+    itemName = entry->name;
+    bRunning = entry->value->isRunning();
 
     if ((bRunning && bIncludeRunning) ||
         (!bRunning && bIncludeStopped))
     {
-       for(uint j=0, eposj = matchers.size(); j != eposj; j++)
-         if (matchers[j].isMatching(itemName)) {
-            output.addChild(itemName, new dtp::dnode(p->second->getTotal()));
-            break;
-         }
+      if (filter.isMatching(itemName))
+        output.addChild(itemName, new dtp::dnode(entry->value->getTotal()));
     }
   }
 }
 
+void Timer::visitByPrefix(const dtpString &prefix, TimerVisitorIntf *visitor)
+{
+  Details::EpochGuard guard;
+  std::vector<uint> indexes;
+  const Details::TimerItemRegistry::Entry *entry;
+  TimerStats stats;
+
+  findByPrefix(prefix, indexes);
+  std::sort(indexes.begin(), indexes.end());
+
+  for (uint i=0, epos = indexes.size(); i != epos; i++)
+  {
+    entry = m_items.at(indexes[i]);
+    if (entry != DTP_NULL)
+    {
+      entry->value->getStats(stats);
+      visitor->visitStats(entry->name, stats);
+    }
+  }
+}
+
+cpu_ticks Timer::getTotalByPrefix(const dtpString &prefix)
+{
+  Details::EpochGuard guard;
+  std::vector<uint> indexes;
+  const Details::TimerItemRegistry::Entry *entry;
+  cpu_ticks res = 0;
+
+  findByPrefix(prefix, indexes);
+  for (uint i=0, epos = indexes.size(); i != epos; i++)
+  {
+    entry = m_items.at(indexes[i]);
+    if (entry != DTP_NULL)
+      res += entry->value->getTotal();
+  }
+  return res;
+}
+
 // ----------------------------------------------------------------------------
 // LocalTimer
 // ----------------------------------------------------------------------------
@@ -409,27 +1148,27 @@ dtp::dnode LocalTimer::removeNonMatching(const dtp::dnode &input, const dtp::dno
 {
   dtp::dnode res;
   dtpString name;
-  bool found, bRunning;
+  bool bRunning;
   bool bIncludeRunning = (statusMask & tsfRunning) != 0; 
   bool bIncludeStopped = (statusMask & tfsStopped) != 0;
+  CompiledFilter filter;
 
   res.setAsParent();
+  build_filter(filterList, filter);
 
-  for(uint j=0, eposj = filterList.size(); j != eposj; j++)
+  for(uint i=0, epos = input.size(); i != epos; i++)
   {
-    WildcardMatcher matcher(filterList.getString(j));
-    for(uint i=0, epos = input.size(); i != epos; i++)
+    name = input.getElementName(i);
+    if (!filter.isMatching(name))
+      continue;
+
+    bRunning = checkItem(name)->isRunning();
+
+    if ((bRunning && bIncludeRunning) ||
+        (!bRunning && bIncludeStopped))
     {
-      name = input.getElementName(i);
-      found = false;
-      bRunning = checkItem(name)->isRunning();
-
-      if ((bRunning && bIncludeRunning) ||
-          (!bRunning && bIncludeStopped))
-      {
-        if (!res.hasChild(name) && matcher.isMatching(name))
-          res.addChild(name, new dtp::dnode(input.getElement(i)));
-      }
+      if (!res.hasChild(name))
+        res.addChild(name, new dtp::dnode(input.getElement(i)));
     }
   }
   return res;
@@ -437,11 +1176,11 @@ dtp::dnode LocalTimer::removeNonMatching(const dtp::dnode &input, const dtp::dno
 
 void LocalTimer::visitAll(TimerVisitorIntf *visitor)
 {
-  cpu_ticks itemTime;
+  TimerStats stats;
   for (Details::TimerItemMapColn::iterator p = m_items.begin(); p != m_items.end(); p++)
   {
-    itemTime = p->second->getTotal();
-    visitor->visit(p->first, itemTime);
+    p->second->getStats(stats);
+    visitor->visitStats(p->first, stats);
   }
 }
 
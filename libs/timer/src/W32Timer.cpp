@@ -11,6 +11,22 @@
 
 #include "perf/W32Timer.h"
 
+// frequency is fixed at system boot, it is queried once
+static volatile cpu_ticks w32_ticks_per_sec = 0;
+
+static cpu_ticks w32_frequency()
+{
+  cpu_ticks res = w32_ticks_per_sec;
+  if (res == 0)
+  {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency( &frequency );
+    res = frequency.QuadPart;
+    w32_ticks_per_sec = res;
+  }
+  return res;
+}
+
 cpu_ticks w32_cpu_time_ticks()
 {
   LARGE_INTEGER watch;
@@ -21,13 +37,16 @@ cpu_ticks w32_cpu_time_ticks()
 cpu_ticks w32_cpu_time_ticks_to_ms(cpu_ticks ticks)
 {
   double res;
-  LARGE_INTEGER frequency;
-  QueryPerformanceFrequency( &frequency );
-  res = (static_cast<double>(ticks) /static_cast<double>(frequency.QuadPart));
+  res = (static_cast<double>(ticks) /static_cast<double>(w32_frequency()));
   res *= 1000.0;
   return static_cast<cpu_ticks>(res);
 }
 
+cpu_ticks w32_cpu_time_ticks_per_sec()
+{
+  return w32_frequency();
+}
+
 cpu_ticks w32_os_uptime_ms()
 {
   return GetTickCount64();
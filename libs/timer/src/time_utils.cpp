@@ -7,9 +7,17 @@
 // Created:     04/10/2008
 /////////////////////////////////////////////////////////////////////////////
 
+#ifndef WIN32
+#include <time.h>
+#endif
+
 #include "perf/time_utils.h"
 #include "perf/W32Timer.h"
 
+#ifndef WIN32
+#include "perf/ClockSource.h"
+#endif
+
 double cpu_time()
 {
   double res;
@@ -25,24 +33,50 @@ cpu_ticks cpu_time_ms()
 #ifndef PERF_USE_WIN32_TICKS
 cpu_ticks cpu_time_ticks()
 {
+#ifdef WIN32
   clock_t t = clock();
   if (t != static_cast<clock_t>(-1))
     return t;
   else
     return 0;
+#else
+  return perf::ClockSource::now();
+#endif
 }
 #endif // PERF_USE_WIN32_TICKS
 
 #ifndef PERF_USE_WIN32_TICKS
 cpu_ticks cpu_time_ticks_to_ms(cpu_ticks ticks)
 {
+#ifndef WIN32
+  return perf::ClockSource::ticksToMs(ticks);
+#else
   double res;
   res = (double) ticks / (double) CLOCKS_PER_SEC;
   res *= 1000.0;
   return (cpu_ticks)res;
+#endif
 }
 #endif // PERF_USE_WIN32_TICKS
 
+#ifndef PERF_USE_WIN32_TICKS
+cpu_ticks cpu_time_ticks_per_sec()
+{
+#ifndef WIN32
+  return perf::ClockSource::getFrequency();
+#else
+  return CLOCKS_PER_SEC;
+#endif
+}
+#endif // PERF_USE_WIN32_TICKS
+
+uint64 cpu_time_ticks_to_ns(cpu_ticks ticks)
+{
+  cpu_ticks freq = cpu_time_ticks_per_sec();
+  // split to avoid overflow of ticks * 10^9
+  return (ticks / freq) * 1000000000ULL + ((ticks % freq) * 1000000000ULL) / freq;
+}
+
 bool is_cpu_time_elapsed_ms(cpu_ticks a_startTime, cpu_ticks a_delay)
 {
   bool res;
@@ -68,8 +102,14 @@ uint64 calc_cpu_time_delay(uint64 startTime, uint64 endTime)
     res = endTime - startTime;
   else
   {
+#ifdef WIN32
     uint64 maxTicks = uint64(0) - 1;
     res = endTime + (maxTicks - startTime) + 1;
+#else
+    // 64-bit monotonic sources do not wrap, end before start is a small 
+    // backward step (e.g. TSC read on another core)
+    res = 0;
+#endif
   }
   return res;
 }
@@ -79,6 +119,9 @@ uint64 os_uptime_ms()
 #ifdef WIN32
    return w32_os_uptime_ms();
 #else
-  return 0;
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0;
+  return static_cast<uint64>(ts.tv_sec) * 1000 + static_cast<uint64>(ts.tv_nsec) / 1000000;
 #endif
 }